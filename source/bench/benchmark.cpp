@@ -0,0 +1,432 @@
+#include "../lib/DatasetManagement.h"
+#include "../lib/MergeStats.h"
+using mergetiff::ArgsArray;
+using mergetiff::BlockLayout;
+using mergetiff::CompressionCodec;
+using mergetiff::CompressionProfile;
+using mergetiff::DatasetManagement;
+using mergetiff::DriverOptions;
+using mergetiff::GDALDatasetRef;
+using mergetiff::Interleave;
+using mergetiff::MergeOptions;
+using mergetiff::OutputLayout;
+using mergetiff::RasterData;
+using mergetiff::RasterIO;
+using mergetiff::RasterLayout;
+using mergetiff::Stopwatch;
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+using std::clog;
+using std::endl;
+
+//The settings that apply to every benchmark
+class BenchmarkSettings
+{
+	public:
+		
+		BenchmarkSettings() : size(1024), iterations(3), workdir(".") {}
+		
+		//The width and height of the synthetic datasets
+		unsigned int size;
+		
+		//The number of times each benchmark is run (the fastest and median runs are reported)
+		unsigned int iterations;
+		
+		//The directory in which the synthetic datasets and benchmark outputs are created
+		string workdir;
+		
+		//Only benchmarks whose identifier contains this string are run
+		string filter;
+};
+
+//Describes the synthetic input dataset for a set of benchmarks
+class BenchmarkCase
+{
+	public:
+		
+		BenchmarkCase(GDALDataType dtype, unsigned int bands, BlockLayout layout, CompressionCodec codec) :
+			dtype(dtype), bands(bands), layout(layout), codec(codec) {}
+		
+		//Returns the name of the block layout
+		string layoutName() const {
+			return (this->layout == BlockLayout::Striped) ? "striped" : "tiled";
+		}
+		
+		//Returns a unique identifier for the case, which is also used as the filename of its synthetic dataset
+		string id() const {
+			return string(GDALGetDataTypeName(this->dtype)) + "-" + std::to_string(this->bands) + "band-" + this->layoutName() + "-" + CompressionProfile(this->codec).name();
+		}
+		
+		//Returns the merge options that produce an output with the case's layout and codec
+		MergeOptions mergeOptions() const
+		{
+			MergeOptions options;
+			options.blockLayout = this->layout;
+			options.blockSize = 256;
+			options.interleave = Interleave::Pixel;
+			options.compression = CompressionProfile(this->codec);
+			return options;
+		}
+		
+		//Returns the GeoTiff creation options that produce a dataset with the case's layout and codec
+		ArgsArray creationOptions() const
+		{
+			ArgsArray options = DriverOptions::geoTiffOptions(this->dtype, CompressionProfile(this->codec));
+			OutputLayout::resolve(this->mergeOptions()).addCreationOptions(options);
+			return options;
+		}
+		
+		GDALDataType dtype;
+		unsigned int bands;
+		BlockLayout layout;
+		CompressionCodec codec;
+};
+
+//The timing results for a single benchmark
+class BenchmarkResult
+{
+	public:
+		
+		string benchmark;
+		string caseId;
+		uint64_t bytes;
+		vector<double> seconds;
+		
+		//Returns the wall time of the fastest run
+		double minSeconds() const {
+			return *std::min_element(this->seconds.begin(), this->seconds.end());
+		}
+		
+		//Returns the wall time of the median run
+		double medianSeconds() const
+		{
+			vector<double> sorted = this->seconds;
+			std::sort(sorted.begin(), sorted.end());
+			return sorted[sorted.size() / 2];
+		}
+		
+		//Returns the throughput of the fastest run in megabytes per second, based on the uncompressed size of the raster data
+		double throughput() const
+		{
+			double fastest = this->minSeconds();
+			return (fastest > 0.0) ? ((double)(this->bytes) / (1024.0 * 1024.0)) / fastest : 0.0;
+		}
+};
+
+//The maximum width and height of the synthetic datasets
+const unsigned int MAX_SIZE = 65536;
+
+//Parses the value of a numeric command-line option, which must be an integer within the specified range
+//(std::stoull accepts a leading minus sign and negates the result, so negative values are rejected before parsing rather than wrapping around)
+unsigned int parseNumericOption(const string& option, const string& value, unsigned int minimum, unsigned int maximum)
+{
+	try
+	{
+		size_t end = 0;
+		unsigned long long parsed = (value.find('-') == string::npos) ? std::stoull(value, &end) : 0;
+		if (value.find('-') == string::npos && end == value.size() && parsed >= minimum && parsed <= maximum) {
+			return (unsigned int)(parsed);
+		}
+	}
+	catch (std::logic_error&) {}
+	
+	throw std::runtime_error("invalid value \"" + value + "\" for option " + option + " (expected an integer between " + std::to_string(minimum) + " and " + std::to_string(maximum) + ")");
+}
+
+//Formats a floating-point value for JSON output
+string formatNumber(double value)
+{
+	char buffer[64];
+	snprintf(buffer, sizeof(buffer), "%.6f", value);
+	return string(buffer);
+}
+
+//Generates deterministic synthetic raster data containing smooth gradients with a small amount of pseudorandom noise,
+//which compresses similarly to real imagery (the values fit within the range of every supported datatype)
+template <typename PrimitiveTy>
+RasterData<PrimitiveTy> generateRaster(unsigned int bands, unsigned int size)
+{
+	RasterData<PrimitiveTy> data(bands, size, size);
+	PrimitiveTy* buffer = data.getBuffer();
+	uint32_t state = 0x9E3779B9;
+	for (uint64_t row = 0; row < size; ++row)
+	{
+		for (uint64_t col = 0; col < size; ++col)
+		{
+			for (uint64_t band = 0; band < bands; ++band)
+			{
+				//Advance the xorshift generator
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				
+				uint64_t gradient = ((row / 4) + (col / 4) + (band * 17)) % 200;
+				buffer[(((row * size) + col) * bands) + band] = (PrimitiveTy)(gradient + (state % 8));
+			}
+		}
+	}
+	
+	return data;
+}
+
+//Runs a benchmark the specified number of times, recording the wall time of each run
+void timeRuns(BenchmarkResult& result, unsigned int iterations, const std::function<bool()>& run)
+{
+	for (unsigned int iteration = 0; iteration < iterations; ++iteration)
+	{
+		Stopwatch stopwatch;
+		if (run() == false) {
+			throw std::runtime_error("benchmark " + result.benchmark + " failed for case " + result.caseId);
+		}
+		
+		result.seconds.push_back(stopwatch.elapsed());
+	}
+}
+
+//Runs the benchmarks for a single case, generating its synthetic dataset first
+//(Datasets are reopened for every run so that each run reads from the file rather than from the GDAL block cache)
+template <typename PrimitiveTy>
+void runCase(const BenchmarkCase& benchmarkCase, const BenchmarkSettings& settings, vector<BenchmarkResult>& results)
+{
+	string inputFile = settings.workdir + "/" + benchmarkCase.id() + ".tif";
+	string outputFile = settings.workdir + "/" + benchmarkCase.id() + ".out.tif";
+	RasterData<PrimitiveTy> data;
+	std::map< string, std::function<bool()> > benchmarks;
+	
+	//(The synthetic data is read back into its own buffer, since the values that are read are identical)
+	benchmarks["bandToBuffer"] = [&]()
+	{
+		GDALDatasetRef dataset = DatasetManagement::openDataset(inputFile);
+		bool success = true;
+		for (unsigned int band = 0; band < benchmarkCase.bands && success; ++band) {
+			success = RasterIO::bandToBuffer<PrimitiveTy>(dataset->GetRasterBand(band + 1), data, benchmarkCase.bands, settings.size, settings.size, band);
+		}
+		
+		return success;
+	};
+	
+	benchmarks["readDataset"] = [&]()
+	{
+		GDALDatasetRef dataset = DatasetManagement::openDataset(inputFile);
+		RasterData<PrimitiveTy> read = RasterIO::readDataset<PrimitiveTy>(dataset, benchmarkCase.dtype);
+		return read.getBuffer() != nullptr;
+	};
+	
+	benchmarks["readDatasetParallel"] = [&]()
+	{
+		GDALDatasetRef dataset = DatasetManagement::openDataset(inputFile);
+		RasterData<PrimitiveTy> read = RasterIO::readDataset<PrimitiveTy>(dataset, benchmarkCase.dtype, vector<unsigned int>(), 0);
+		return read.getBuffer() != nullptr;
+	};
+	
+	benchmarks["readDatasetPlanar"] = [&]()
+	{
+		GDALDatasetRef dataset = DatasetManagement::openDataset(inputFile);
+		RasterData<PrimitiveTy> read = RasterIO::readDataset<PrimitiveTy>(dataset, benchmarkCase.dtype, vector<unsigned int>(), 1, nullptr, RasterLayout::Planar);
+		return read.getBuffer() != nullptr;
+	};
+	
+	benchmarks["writeDataset"] = [&]()
+	{
+		GDALDatasetRef dataset = DatasetManagement::datasetFromRaster(data, false, "GTiff", outputFile, benchmarkCase.creationOptions());
+		MERGETIFF_SMART_POINTER_RESET(dataset, nullptr);
+		return VSIUnlink(outputFile.c_str()) == 0;
+	};
+	
+	benchmarks["rasterToFile"] = [&]()
+	{
+		GDALDatasetRef dataset = DatasetManagement::rasterToFile(outputFile, data);
+		MERGETIFF_SMART_POINTER_RESET(dataset, nullptr);
+		return VSIUnlink(outputFile.c_str()) == 0;
+	};
+	
+	benchmarks["wrapRasterData"] = [&]()
+	{
+		GDALDatasetRef dataset = DatasetManagement::wrapRasterData(data);
+		RasterData<PrimitiveTy> read = RasterIO::readDataset<PrimitiveTy>(dataset, benchmarkCase.dtype);
+		return read.getBuffer() != nullptr;
+	};
+	
+	benchmarks["createMergedDataset"] = [&]()
+	{
+		GDALDatasetRef dataset = DatasetManagement::openDataset(inputFile);
+		vector<GDALRasterBand*> bands = DatasetManagement::getAllRasterBands(dataset);
+		GDALDatasetRef merged = DatasetManagement::createMergedDataset(outputFile, dataset, bands, nullptr, benchmarkCase.mergeOptions());
+		MERGETIFF_SMART_POINTER_RESET(merged, nullptr);
+		return VSIUnlink(outputFile.c_str()) == 0;
+	};
+	
+	//Determine which of the benchmarks match the filter, skipping the case entirely if none of them do
+	vector<string> selected;
+	for (auto& benchmark : benchmarks)
+	{
+		if ((benchmark.first + "/" + benchmarkCase.id()).find(settings.filter) != string::npos) {
+			selected.push_back(benchmark.first);
+		}
+	}
+	if (selected.empty()) {
+		return;
+	}
+	
+	//Generate the synthetic dataset
+	data = generateRaster<PrimitiveTy>(benchmarkCase.bands, settings.size);
+	GDALDatasetRef input = DatasetManagement::datasetFromRaster(data, false, "GTiff", inputFile, benchmarkCase.creationOptions());
+	if (!input) {
+		throw std::runtime_error("failed to generate synthetic dataset \"" + inputFile + "\"");
+	}
+	MERGETIFF_SMART_POINTER_RESET(input, nullptr);
+	
+	//Run each of the selected benchmarks in a stable order (each one processes every pixel of every band)
+	for (auto& name : selected)
+	{
+		BenchmarkResult result;
+		result.benchmark = name;
+		result.caseId = benchmarkCase.id();
+		result.bytes = (uint64_t)(settings.size) * settings.size * benchmarkCase.bands * sizeof(PrimitiveTy);
+		clog << "Running " << result.benchmark << " for " << result.caseId << "..." << endl;
+		timeRuns(result, settings.iterations, benchmarks[name]);
+		results.push_back(result);
+	}
+	
+	VSIUnlink(inputFile.c_str());
+}
+
+//Serialises the benchmark results to a JSON object
+string resultsToJson(const vector<BenchmarkCase>& cases, const vector<BenchmarkResult>& results, const BenchmarkSettings& settings)
+{
+	string json = "{\n";
+	json += "  \"gdalVersion\": \"" + string(GDALVersionInfo("RELEASE_NAME")) + "\",\n";
+	json += "  \"size\": " + std::to_string(settings.size) + ",\n";
+	json += "  \"iterations\": " + std::to_string(settings.iterations) + ",\n";
+	json += "  \"results\": [";
+	for (size_t index = 0; index < results.size(); ++index)
+	{
+		const BenchmarkResult& result = results[index];
+		const BenchmarkCase& benchmarkCase = *std::find_if(cases.begin(), cases.end(), [&result](const BenchmarkCase& c) { return c.id() == result.caseId; });
+		json += (index > 0) ? ",\n" : "\n";
+		json += "    {\"benchmark\": \"" + result.benchmark + "\", \"case\": \"" + result.caseId + "\"";
+		json += ", \"datatype\": \"" + string(GDALGetDataTypeName(benchmarkCase.dtype)) + "\"";
+		json += ", \"bands\": " + std::to_string(benchmarkCase.bands);
+		json += ", \"layout\": \"" + benchmarkCase.layoutName() + "\"";
+		json += ", \"compression\": \"" + CompressionProfile(benchmarkCase.codec).name() + "\"";
+		json += ", \"bytes\": " + std::to_string(result.bytes);
+		json += ", \"minSeconds\": " + formatNumber(result.minSeconds());
+		json += ", \"medianSeconds\": " + formatNumber(result.medianSeconds());
+		json += ", \"MBps\": " + formatNumber(result.throughput()) + "}";
+	}
+	json += results.empty() ? "]\n" : "\n  ]\n";
+	json += "}";
+	return json;
+}
+
+int main (int argc, char* argv[])
+{
+	try
+	{
+		//Parse the command-line options
+		BenchmarkSettings settings;
+		string outputFile;
+		for (int i = 1; i < argc; ++i)
+		{
+			string arg = argv[i];
+			if (i + 1 >= argc) {
+				throw std::runtime_error("no value specified for option " + arg);
+			}
+			
+			string value = argv[++i];
+			if (arg == "--size") {
+				settings.size = parseNumericOption(arg, value, 1, MAX_SIZE);
+			}
+			else if (arg == "--iterations") {
+				settings.iterations = parseNumericOption(arg, value, 1, std::numeric_limits<unsigned int>::max());
+			}
+			else if (arg == "--workdir") {
+				settings.workdir = value;
+			}
+			else if (arg == "--filter") {
+				settings.filter = value;
+			}
+			else if (arg == "--output") {
+				outputFile = value;
+			}
+			else
+			{
+				clog << "Usage:" << endl;
+				clog << "mergetiff-bench [OPTIONS]" << endl;
+				clog << endl;
+				clog << "Options:" << endl;
+				clog << "  --size <N>           Width and height of the synthetic datasets (default: 1024, maximum: 65536)" << endl;
+				clog << "  --iterations <N>     Number of times each benchmark is run (default: 3)" << endl;
+				clog << "  --workdir <DIR>      Directory in which the synthetic datasets are created (default: current directory)" << endl;
+				clog << "  --filter <STRING>    Only runs benchmarks whose BENCHMARK/CASE identifier contains the string" << endl;
+				clog << "  --output <FILE>      Writes the JSON results to the file instead of stdout" << endl;
+				return 1;
+			}
+		}
+		
+		//Build the matrix of cases, covering the datatypes, band counts, block layouts and codecs that matter most in practice
+		GDALAllRegister();
+		vector<BenchmarkCase> cases;
+		for (GDALDataType dtype : {GDT_Byte, GDT_UInt16, GDT_Float32})
+		{
+			for (unsigned int bands : {1u, 4u})
+			{
+				for (BlockLayout layout : {BlockLayout::Tiled, BlockLayout::Striped})
+				{
+					for (CompressionCodec codec : {CompressionCodec::None, CompressionCodec::LZW, CompressionCodec::Deflate}) {
+						cases.push_back(BenchmarkCase(dtype, bands, layout, codec));
+					}
+				}
+			}
+		}
+		
+		//Run the benchmarks for each case
+		vector<BenchmarkResult> results;
+		for (auto& benchmarkCase : cases)
+		{
+			#define _RUN_CASE(GdalTy, PrimitiveTy) case GdalTy: runCase<PrimitiveTy>(benchmarkCase, settings, results); break
+			switch (benchmarkCase.dtype)
+			{
+				_RUN_CASE(GDT_Byte,    uint8_t);
+				_RUN_CASE(GDT_UInt16,  uint16_t);
+				_RUN_CASE(GDT_Float32, float);
+				
+				default:
+					throw std::runtime_error("unsupported benchmark datatype");
+			}
+			#undef _RUN_CASE
+		}
+		
+		//Output the results
+		string json = resultsToJson(cases, results, settings);
+		if (outputFile.empty() == false)
+		{
+			std::ofstream output(outputFile);
+			output << json << endl;
+			if (!output) {
+				throw std::runtime_error("failed to write results to \"" + outputFile + "\"");
+			}
+		}
+		else {
+			std::cout << json << endl;
+		}
+		
+		return 0;
+	}
+	catch (std::runtime_error& e)
+	{
+		clog << "Error: " << e.what() << endl;
+		return 1;
+	}
+}
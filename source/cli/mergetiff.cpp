@@ -1,36 +1,360 @@
 #include "../lib/DatasetManagement.h"
 #include "../lib/Utility.h"
+using mergetiff::AccessPattern;
+using mergetiff::BlockLayout;
+using mergetiff::CompressionCodec;
+using mergetiff::CompressionTarget;
 using mergetiff::DatasetManagement;
 using mergetiff::GDALDatasetRef;
+using mergetiff::GridAlignment;
+using mergetiff::Interleave;
+using mergetiff::MemoryUsage;
+using mergetiff::MergeEngine;
+using mergetiff::MergeOptions;
+using mergetiff::MergeStats;
+using mergetiff::OutputFormat;
+using mergetiff::OverviewResampling;
+using mergetiff::Stopwatch;
 using mergetiff::Utility;
 
+#include <limits>
+#include <map>
 #include <string>
 #include <vector>
 #include <iostream>
 using std::string;
 using std::vector;
 using std::clog;
+using std::cout;
 using std::endl;
 
+//The maximum number of worker threads that can be requested on the command line
+const unsigned int MAX_THREADS = 1024;
+
+//Parses the value of a numeric command-line option, which must be a non-negative integer no greater than the specified maximum
+//(std::stoull accepts a leading minus sign and negates the result, so negative values are rejected before parsing rather than wrapping around)
+unsigned int parseNumericOption(const string& option, const string& value, unsigned int maximum = std::numeric_limits<unsigned int>::max())
+{
+	try
+	{
+		size_t end = 0;
+		unsigned long long parsed = (value.find('-') == string::npos) ? std::stoull(value, &end) : 0;
+		if (value.find('-') == string::npos && end == value.size() && parsed <= maximum) {
+			return (unsigned int)(parsed);
+		}
+	}
+	catch (std::logic_error&) {}
+	
+	throw std::runtime_error("invalid value \"" + value + "\" for option " + option + " (expected an integer between 0 and " + std::to_string(maximum) + ")");
+}
+
+//Parses the value of a command-line option that accepts a comma-separated list of floating-point values
+vector<double> parseListOption(const string& option, const string& value)
+{
+	try
+	{
+		vector<double> values;
+		for (auto item : Utility::strSplit(value, ",")) {
+			values.push_back(std::stod(item));
+		}
+		
+		return values;
+	}
+	catch (std::logic_error&) {
+		throw std::runtime_error("invalid value \"" + value + "\" for option " + option);
+	}
+}
+
+//Retrieves the value for the specified band from a list of per-band values, where a single value applies to all bands
+double valueForBand(const vector<double>& values, const string& option, size_t band, size_t numBands, double defaultValue)
+{
+	if (values.empty()) {
+		return defaultValue;
+	}
+	
+	if (values.size() != 1 && values.size() != numBands) {
+		throw std::runtime_error("option " + option + " must specify either one value or one value per output band");
+	}
+	
+	return (values.size() == 1) ? values[0] : values[band];
+}
+
 int main (int argc, char* argv[])
 {
 	try
 	{
+		//Separate the options from the positional arguments
+		MergeOptions options;
+		vector<string> args;
+		vector<double> scales;
+		vector<double> offsets;
+		vector<double> clampRange;
+		bool jsonStats = false;
+		for (int i = 1; i < argc; ++i)
+		{
+			string arg = argv[i];
+			if (arg.compare(0, 2, "--") != 0 || arg.size() == 2)
+			{
+				args.push_back(arg);
+				continue;
+			}
+			
+			//All of our options require a value
+			if (i + 1 >= argc) {
+				throw std::runtime_error("no value specified for option " + arg);
+			}
+			
+			string value = argv[++i];
+			if (arg == "--threads") {
+				options.numThreads = parseNumericOption(arg, value, MAX_THREADS);
+			}
+			else if (arg == "--block-size") {
+				options.blockSize = (value == "auto") ? 0 : parseNumericOption(arg, value);
+			}
+			else if (arg == "--engine")
+			{
+				if (value == "tiled") {
+					options.engine = MergeEngine::Tiled;
+				}
+				else if (value == "vrt") {
+					options.engine = MergeEngine::VRT;
+				}
+				else {
+					throw std::runtime_error("unknown merge engine \"" + value + "\"");
+				}
+			}
+			else if (arg == "--output-type")
+			{
+				options.outputType = (value == "auto") ? GDT_Unknown : GDALGetDataTypeByName(value.c_str());
+				if (value != "auto" && options.outputType == GDT_Unknown) {
+					throw std::runtime_error("unknown output datatype \"" + value + "\"");
+				}
+			}
+			else if (arg == "--scale") {
+				scales = parseListOption(arg, value);
+			}
+			else if (arg == "--offset") {
+				offsets = parseListOption(arg, value);
+			}
+			else if (arg == "--clamp")
+			{
+				clampRange = parseListOption(arg, value);
+				if (clampRange.size() != 2 || clampRange[0] > clampRange[1]) {
+					throw std::runtime_error("option --clamp requires a value of the form MIN,MAX");
+				}
+			}
+			else if (arg == "--expression") {
+				options.bandExpressions.push_back(value);
+			}
+			else if (arg == "--align")
+			{
+				static const std::map<string, GridAlignment> alignments = {
+					{"none",         GridAlignment::None},
+					{"first",        GridAlignment::FirstInput},
+					{"union",        GridAlignment::Union},
+					{"intersection", GridAlignment::Intersection}
+				};
+				
+				auto alignment = alignments.find(value);
+				if (alignment == alignments.end()) {
+					throw std::runtime_error("unknown grid alignment \"" + value + "\"");
+				}
+				
+				options.alignment = alignment->second;
+			}
+			else if (arg == "--resampling")
+			{
+				static const std::map<string, GDALRIOResampleAlg> algorithms = {
+					{"nearest",     GRIORA_NearestNeighbour},
+					{"bilinear",    GRIORA_Bilinear},
+					{"cubic",       GRIORA_Cubic},
+					{"cubicspline", GRIORA_CubicSpline},
+					{"lanczos",     GRIORA_Lanczos},
+					{"average",     GRIORA_Average},
+					{"mode",        GRIORA_Mode}
+				};
+				
+				auto algorithm = algorithms.find(value);
+				if (algorithm == algorithms.end()) {
+					throw std::runtime_error("unknown resampling algorithm \"" + value + "\"");
+				}
+				
+				options.resampling = algorithm->second;
+			}
+			else if (arg == "--format")
+			{
+				if (value == "geotiff") {
+					options.format = OutputFormat::GeoTiff;
+				}
+				else if (value == "cog") {
+					options.format = OutputFormat::COG;
+				}
+				else {
+					throw std::runtime_error("unknown output format \"" + value + "\"");
+				}
+			}
+			else if (arg == "--overview-resampling")
+			{
+				if (value == "average") {
+					options.overviewResampling = OverviewResampling::Average;
+				}
+				else if (value == "nearest") {
+					options.overviewResampling = OverviewResampling::Nearest;
+				}
+				else {
+					throw std::runtime_error("unknown overview resampling algorithm \"" + value + "\"");
+				}
+			}
+			else if (arg == "--copy-tiles")
+			{
+				if (value == "yes" || value == "no") {
+					options.copyCompressedTiles = (value == "yes");
+				}
+				else {
+					throw std::runtime_error("option --copy-tiles requires a value of \"yes\" or \"no\"");
+				}
+			}
+			else if (arg == "--compress")
+			{
+				static const std::map<string, CompressionCodec> codecs = {
+					{"lzw",     CompressionCodec::LZW},
+					{"deflate", CompressionCodec::Deflate},
+					{"zstd",    CompressionCodec::ZSTD},
+					{"lerc",    CompressionCodec::LERC},
+					{"none",    CompressionCodec::None},
+					{"auto",    CompressionCodec::Auto}
+				};
+				
+				auto codec = codecs.find(value);
+				if (codec == codecs.end()) {
+					throw std::runtime_error("unknown compression codec \"" + value + "\"");
+				}
+				
+				options.compression.codec = codec->second;
+			}
+			else if (arg == "--compress-level") {
+				options.compression.level = parseNumericOption(arg, value);
+			}
+			else if (arg == "--max-error")
+			{
+				vector<double> maxError = parseListOption(arg, value);
+				if (maxError.size() != 1 || maxError[0] < 0.0) {
+					throw std::runtime_error("option --max-error requires a single non-negative value");
+				}
+				
+				options.compression.maxError = maxError[0];
+			}
+			else if (arg == "--compress-target")
+			{
+				static const std::map<string, CompressionTarget> targets = {
+					{"size",     CompressionTarget::Size},
+					{"balanced", CompressionTarget::Balanced},
+					{"speed",    CompressionTarget::Speed}
+				};
+				
+				auto target = targets.find(value);
+				if (target == targets.end()) {
+					throw std::runtime_error("unknown compression target \"" + value + "\"");
+				}
+				
+				options.compression.target = target->second;
+			}
+			else if (arg == "--memory-budget") {
+				options.memoryBudget = (uint64_t)(parseNumericOption(arg, value)) * 1024 * 1024;
+			}
+			else if (arg == "--layout")
+			{
+				static const std::map<string, BlockLayout> layouts = {
+					{"auto",    BlockLayout::Auto},
+					{"tiled",   BlockLayout::Tiled},
+					{"striped", BlockLayout::Striped}
+				};
+				
+				auto layout = layouts.find(value);
+				if (layout == layouts.end()) {
+					throw std::runtime_error("unknown block layout \"" + value + "\"");
+				}
+				
+				options.blockLayout = layout->second;
+			}
+			else if (arg == "--interleave")
+			{
+				static const std::map<string, Interleave> interleaves = {
+					{"auto",  Interleave::Auto},
+					{"pixel", Interleave::Pixel},
+					{"band",  Interleave::Band}
+				};
+				
+				auto interleave = interleaves.find(value);
+				if (interleave == interleaves.end()) {
+					throw std::runtime_error("unknown interleave \"" + value + "\"");
+				}
+				
+				options.interleave = interleave->second;
+			}
+			else if (arg == "--access-pattern")
+			{
+				static const std::map<string, AccessPattern> patterns = {
+					{"full-scan",     AccessPattern::FullScan},
+					{"per-band",      AccessPattern::PerBand},
+					{"random-window", AccessPattern::RandomWindow}
+				};
+				
+				auto pattern = patterns.find(value);
+				if (pattern == patterns.end()) {
+					throw std::runtime_error("unknown access pattern \"" + value + "\"");
+				}
+				
+				options.accessPattern = pattern->second;
+			}
+			else if (arg == "--sparse")
+			{
+				if (value == "yes" || value == "no") {
+					options.sparseOutput = (value == "yes");
+				}
+				else {
+					throw std::runtime_error("option --sparse requires a value of \"yes\" or \"no\"");
+				}
+			}
+			else if (arg == "--band-stats")
+			{
+				if (value == "yes" || value == "no") {
+					options.computeStatistics = (value == "yes");
+				}
+				else {
+					throw std::runtime_error("option --band-stats requires a value of \"yes\" or \"no\"");
+				}
+			}
+			else if (arg == "--stats")
+			{
+				if (value != "json" && value != "none") {
+					throw std::runtime_error("unknown statistics format \"" + value + "\"");
+				}
+				
+				jsonStats = (value == "json");
+			}
+			else {
+				throw std::runtime_error("unknown option " + arg);
+			}
+		}
+		
 		//Check that the required command-line arguments have been supplied
-		if (argc > 3 && argc % 2 == 0)
+		if (args.size() > 2 && args.size() % 2 == 1)
 		{
-			string outputFile = argv[1];
+			string outputFile = args[0];
 			vector<GDALDatasetRef> datasets;
 			vector<GDALRasterBand*> bands;
+			MergeStats stats;
 			
-			//Iterate over each of the input datasets
-			for (int i = 2; i < argc; i += 2)
+			//Iterate over each of the input datasets (timing how long they take to open)
+			Stopwatch openTime;
+			for (size_t i = 1; i < args.size(); i += 2)
 			{
 				//Attempt to open the dataset
-				datasets.emplace_back(DatasetManagement::openDataset(argv[i]));
+				datasets.emplace_back(DatasetManagement::openDataset(args[i]));
 				
 				//Determine if we are including any of the bands from the current dataset
-				string bandStr = argv[i+1];
+				string bandStr = args[i+1];
 				if (bandStr != "-")
 				{
 					try
@@ -52,14 +376,74 @@ int main (int argc, char* argv[])
 				}
 			}
 			
-			//Attempt to create the merged dataset
-			DatasetManagement::createMergedDataset(outputFile, datasets[0], bands, GDALTermProgress);
+			stats.openSeconds = openTime.elapsed();
+			
+			//Build the value transformations for each of the output bands, if any were requested
+			if (!scales.empty() || !offsets.empty() || !clampRange.empty())
+			{
+				for (size_t band = 0; band < bands.size(); ++band)
+				{
+					mergetiff::DatatypeConversion::ValueTransform transform(
+						valueForBand(scales, "--scale", band, bands.size(), 1.0),
+						valueForBand(offsets, "--offset", band, bands.size(), 0.0)
+					);
+					
+					if (!clampRange.empty())
+					{
+						transform.clamp = true;
+						transform.clampMin = clampRange[0];
+						transform.clampMax = clampRange[1];
+					}
+					
+					options.bandTransforms.push_back(transform);
+				}
+			}
+			
+			//Attempt to create the merged dataset (the progress bar is written to stdout, so it is suppressed when printing JSON statistics)
+			DatasetManagement::createMergedDataset(outputFile, datasets[0], bands, (jsonStats ? nullptr : GDALTermProgress), options, &stats);
 			clog << "Created merged dataset \"" << outputFile << "\"." << endl;
+			
+			//Report the peak memory usage of the merge, if it can be determined on this platform
+			uint64_t peakMemory = MemoryUsage::peakResidentBytes();
+			if (peakMemory > 0) {
+				clog << "Peak memory usage: " << (peakMemory / (1024 * 1024)) << "MB." << endl;
+			}
+			
+			//Print the performance statistics for the merge, if requested
+			if (jsonStats == true) {
+				cout << stats.toJson() << endl;
+			}
 		}
 		else
 		{
 			clog << "Usage:" << endl;
-			clog << "mergetiff <OUT.TIF> <IN1.TIF> <BAND1,BAND2,BAND3> [<IN2.TIF> <BAND1,BAND2,BAND3>]" << endl;
+			clog << "mergetiff [OPTIONS] <OUT.TIF> <IN1.TIF> <BAND1,BAND2,BAND3> [<IN2.TIF> <BAND1,BAND2,BAND3>]" << endl;
+			clog << endl;
+			clog << "Options:" << endl;
+			clog << "  --threads <N>        Number of worker threads used to read input tiles (default: all CPU cores, maximum: 1024)" << endl;
+			clog << "  --block-size <N>     Width and height of the output tiles (a multiple of 16) or height of the strips, or auto (default: 256)" << endl;
+			clog << "  --engine <ENGINE>    Merge engine to use, either \"tiled\" or \"vrt\" (default: tiled)" << endl;
+			clog << "  --output-type <TYPE> Output datatype, e.g. Byte, UInt16, Float32 (default: auto, promotes the input datatypes)" << endl;
+			clog << "  --scale <S1,S2,...>  Scale factor applied to each output band, or a single value for all bands" << endl;
+			clog << "  --offset <O1,O2,...> Offset added to each output band after scaling, or a single value for all bands" << endl;
+			clog << "  --clamp <MIN,MAX>    Clamps the output values to the specified range" << endl;
+			clog << "  --expression <EXPR>  Appends a band computed from the input bands, e.g. \"(b4-b3)/(b4+b3)\" (may be repeated)" << endl;
+			clog << "  --align <MODE>       Aligns bands with differing grids: none, first, union or intersection (default: none)" << endl;
+			clog << "  --resampling <ALG>   Resampling for aligned bands: nearest, bilinear, cubic, cubicspline, lanczos, average or mode" << endl;
+			clog << "  --format <FORMAT>    Output format, either \"geotiff\" or \"cog\" (Cloud Optimized GeoTiff) (default: geotiff)" << endl;
+			clog << "  --overview-resampling <ALG>  Resampling for COG overviews, either \"average\" or \"nearest\" (default: average)" << endl;
+			clog << "  --copy-tiles <yes|no>  Copy matching compressed input tiles without re-encoding them (default: yes)" << endl;
+			clog << "  --compress <CODEC>   Output compression: lzw, deflate, zstd, lerc, none or auto (default: lzw)" << endl;
+			clog << "  --compress-level <N> Compression level for deflate (1-9) or zstd (1-22) (default: GDAL default)" << endl;
+			clog << "  --max-error <E>      Maximum error per pixel for lerc compression (default: 0, lossless)" << endl;
+			clog << "  --compress-target <TARGET>  What auto compression optimises for: size, balanced or speed (default: balanced)" << endl;
+			clog << "  --layout <LAYOUT>    Output block layout: tiled, striped or auto (default: auto, selects tiled)" << endl;
+			clog << "  --interleave <MODE>  Output band interleaving: pixel, band or auto (default: auto, based on the access pattern)" << endl;
+			clog << "  --access-pattern <PATTERN>  How the output will be read: full-scan, per-band or random-window (default: full-scan)" << endl;
+			clog << "  --memory-budget <MB> Maximum memory usage of the merge in megabytes (default: unlimited)" << endl;
+			clog << "  --sparse <yes|no>    Omit the blocks of output tiles that contain only \"no data\" from the output file (default: yes)" << endl;
+			clog << "  --band-stats <yes|no>  Store the statistics and histogram of each output band in its metadata (default: no)" << endl;
+			clog << "  --stats <FORMAT>     Prints performance statistics for the merge to stdout, either \"json\" or \"none\" (default: none)" << endl;
 		}
 		
 		return 0;
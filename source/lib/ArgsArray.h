@@ -1,6 +1,7 @@
 #ifndef _MERGETIFF_ARGS_ARRAY
 #define _MERGETIFF_ARGS_ARRAY
 
+#include <cstring>
 #include <initializer_list>
 #include <memory>
 #include <string>
@@ -52,6 +53,21 @@ class ArgsArray
 			return this->structure.data();
 		}
 		
+		//Retrieves the value of the first KEY=VALUE argument with the specified key, or the default value if there is no such argument
+		inline std::string value(const std::string& key, const std::string& defaultValue = "") const
+		{
+			std::string prefix = key + "=";
+			for (auto& arg : this->args)
+			{
+				std::string current(arg.data());
+				if (current.compare(0, prefix.size(), prefix) == 0) {
+					return current.substr(prefix.size());
+				}
+			}
+			
+			return defaultValue;
+		}
+		
 		//Determines if the list is empty
 		inline bool empty() const {
 			return this->args.empty();
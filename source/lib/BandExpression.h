@@ -0,0 +1,416 @@
+#ifndef _MERGETIFF_BAND_EXPRESSION
+#define _MERGETIFF_BAND_EXPRESSION
+
+#include "DatatypeConversion.h"
+#include "ErrorHandling.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace mergetiff {
+
+//An arithmetic expression over raster bands, such as "(b4-b3)/(b4+b3)", compiled into a program that is evaluated over whole blocks of pixels
+//(Expressions support the operators +, -, * and / with the usual precedence, unary minus, parentheses, numeric constants and references to bands,
+// where bN refers to the Nth band of the block. Constant subexpressions are folded when the expression is compiled. The program is evaluated in double
+// precision a fixed-size chunk of pixels at a time, with every instruction applied to the whole chunk in a branch-free loop that the compiler can vectorise.)
+class BandExpression
+{
+	public:
+		
+		//Creates an empty expression
+		BandExpression() : maxDepth(0), highestBand(0), outputHasNoData(false), outputNoData(0.0) {}
+		
+		//Compiles an expression, returning an empty expression if it is invalid
+		static inline BandExpression compile(const std::string& expression)
+		{
+			BandExpression compiled;
+			compiled.source = expression;
+			Parser parser(expression, compiled);
+			parser.parseSum();
+			parser.skipWhitespace();
+			if (parser.error.empty() && parser.position < expression.size()) {
+				parser.error = "unexpected character '" + std::string(1, expression[parser.position]) + "'";
+			}
+			
+			if (parser.error.empty() == false) {
+				return ErrorHandling::handleError<BandExpression>("invalid band expression \"" + expression + "\": " + parser.error);
+			}
+			
+			return compiled;
+		}
+		
+		//Determines if the expression was compiled successfully
+		operator bool() const {
+			return this->program.empty() == false;
+		}
+		
+		//Returns the text of the expression
+		const std::string& expression() const {
+			return this->source;
+		}
+		
+		//Returns the highest band number that the expression refers to (zero if it refers to no bands)
+		unsigned int maxBand() const {
+			return this->highestBand;
+		}
+		
+		//Determines if the expression refers to the specified band (numbered from one)
+		bool refersTo(unsigned int band) const
+		{
+			for (auto& instruction : this->program)
+			{
+				if (instruction.opcode == Opcode::Band && instruction.band + 1 == band) {
+					return true;
+				}
+			}
+			
+			return false;
+		}
+		
+		//Specifies the "no data" value of a band (numbered from one) that the expression refers to, so that pixels containing it produce "no data"
+		void setBandNoData(unsigned int band, double noDataValue)
+		{
+			if (band > this->bandNoData.size())
+			{
+				this->bandHasNoData.resize(band, 0);
+				this->bandNoData.resize(band, 0.0);
+			}
+			
+			this->bandHasNoData[band - 1] = 1;
+			this->bandNoData[band - 1] = noDataValue;
+		}
+		
+		//Specifies the value written for pixels that produce "no data", which also replaces results that are not finite
+		void setOutputNoData(double noDataValue)
+		{
+			this->outputHasNoData = true;
+			this->outputNoData = noDataValue;
+		}
+		
+		//Evaluates the expression for the specified number of pixels, where the bands are stored sequentially with the specified number of elements
+		//between the start of each band, and writes the results to the output buffer (saturating them to the range of the datatype)
+		template <typename PrimitiveTy>
+		void evaluate(const PrimitiveTy* bands, uint64_t bandStride, uint64_t count, PrimitiveTy* output) const
+		{
+			const uint64_t chunkSize = 1024;
+			std::vector<double> registers(std::max<uint64_t>(1, this->maxDepth) * chunkSize);
+			std::vector<uint8_t> invalid(chunkSize);
+			const PrimitiveTy noData = std::isnan(this->outputNoData) ? BandExpression::notANumber<PrimitiveTy>() : DatatypeConversion::saturate<PrimitiveTy>(this->outputNoData);
+			for (uint64_t start = 0; start < count; start += chunkSize)
+			{
+				uint64_t length = std::min(chunkSize, count - start);
+				std::fill(invalid.begin(), invalid.begin() + length, 0);
+				
+				//Run the program over the chunk, with each stack entry occupying a chunk-sized register
+				int top = 0;
+				for (auto& instruction : this->program)
+				{
+					double* next = registers.data() + ((uint64_t)(top) * chunkSize);
+					double* last = next - chunkSize;
+					double* previous = last - chunkSize;
+					switch (instruction.opcode)
+					{
+						case Opcode::Band:
+						{
+							const PrimitiveTy* values = bands + (instruction.band * bandStride) + start;
+							for (uint64_t index = 0; index < length; ++index) {
+								next[index] = (double)(values[index]);
+							}
+							
+							//Pixels containing the band's "no data" value invalidate the result
+							if (instruction.band < this->bandHasNoData.size() && this->bandHasNoData[instruction.band] == 1)
+							{
+								const PrimitiveTy bandNoData = DatatypeConversion::saturate<PrimitiveTy>(std::isnan(this->bandNoData[instruction.band]) ? 0.0 : this->bandNoData[instruction.band]);
+								const bool matchNaN = std::isnan(this->bandNoData[instruction.band]);
+								for (uint64_t index = 0; index < length; ++index) {
+									invalid[index] |= (matchNaN ? (values[index] != values[index]) : (values[index] == bandNoData)) ? 1 : 0;
+								}
+							}
+							
+							top += 1;
+							break;
+						}
+						
+						case Opcode::Constant:
+							std::fill(next, next + length, instruction.constant);
+							top += 1;
+							break;
+						
+						case Opcode::Negate:
+							for (uint64_t index = 0; index < length; ++index) {
+								last[index] = -last[index];
+							}
+							break;
+						
+						case Opcode::Add:
+							BandExpression::apply(previous, last, length, [](double a, double b) { return a + b; });
+							top -= 1;
+							break;
+						
+						case Opcode::Subtract:
+							BandExpression::apply(previous, last, length, [](double a, double b) { return a - b; });
+							top -= 1;
+							break;
+						
+						case Opcode::Multiply:
+							BandExpression::apply(previous, last, length, [](double a, double b) { return a * b; });
+							top -= 1;
+							break;
+						
+						case Opcode::Divide:
+							BandExpression::apply(previous, last, length, [](double a, double b) { return a / b; });
+							top -= 1;
+							break;
+					}
+				}
+				
+				//Convert the results to the output datatype (results that are not finite are "no data" if there is a "no data" value, and NaN is zero otherwise)
+				const double* results = registers.data();
+				for (uint64_t index = 0; index < length; ++index)
+				{
+					double value = results[index];
+					bool finite = (value - value == 0.0);
+					bool useNoData = this->outputHasNoData && (invalid[index] == 1 || finite == false);
+					output[start + index] = useNoData ? noData : DatatypeConversion::saturate<PrimitiveTy>((value == value) ? value : 0.0);
+				}
+			}
+		}
+		
+	private:
+		
+		//The operations that make up a compiled program, which runs on a stack of registers
+		enum class Opcode
+		{
+			//Pushes the values of a band
+			Band,
+			
+			//Pushes a constant value
+			Constant,
+			
+			//Negates the top of the stack
+			Negate,
+			
+			//Pops the top two entries of the stack and pushes the result of combining them
+			Add,
+			Subtract,
+			Multiply,
+			Divide
+		};
+		
+		class Instruction
+		{
+			public:
+				
+				Instruction(Opcode opcode, unsigned int band = 0, double constant = 0.0) : opcode(opcode), band(band), constant(constant) {}
+				
+				Opcode opcode;
+				
+				//The band that is pushed (numbered from zero)
+				unsigned int band;
+				
+				//The constant that is pushed
+				double constant;
+		};
+		
+		//Parses an expression by recursive descent, appending the instructions to a compiled expression in postfix order
+		class Parser
+		{
+			public:
+				
+				Parser(const std::string& text, BandExpression& compiled) : text(text), position(0), depth(0), compiled(compiled) {}
+				
+				//Parses a sequence of terms separated by + or -
+				void parseSum()
+				{
+					this->parseProduct();
+					while (this->error.empty() && (this->peek() == '+' || this->peek() == '-'))
+					{
+						Opcode opcode = (this->text[this->position++] == '+') ? Opcode::Add : Opcode::Subtract;
+						this->parseProduct();
+						this->emitBinary(opcode);
+					}
+				}
+				
+				//Parses a sequence of factors separated by * or /
+				void parseProduct()
+				{
+					this->parseUnary();
+					while (this->error.empty() && (this->peek() == '*' || this->peek() == '/'))
+					{
+						Opcode opcode = (this->text[this->position++] == '*') ? Opcode::Multiply : Opcode::Divide;
+						this->parseUnary();
+						this->emitBinary(opcode);
+					}
+				}
+				
+				//Parses a factor with any number of leading signs
+				void parseUnary()
+				{
+					if (this->peek() == '-' || this->peek() == '+')
+					{
+						bool negate = (this->text[this->position++] == '-');
+						this->parseUnary();
+						if (negate && this->error.empty()) {
+							this->emitNegate();
+						}
+						
+						return;
+					}
+					
+					this->parsePrimary();
+				}
+				
+				//Parses a band reference, a numeric constant or a parenthesised expression
+				void parsePrimary()
+				{
+					char next = this->peek();
+					if (next == '(')
+					{
+						this->position += 1;
+						this->parseSum();
+						if (this->error.empty() && this->peek() != ')') {
+							this->error = "expected ')'";
+						}
+						
+						this->position += 1;
+					}
+					else if (next == 'b' || next == 'B')
+					{
+						//Band references are numbered from one
+						size_t start = ++this->position;
+						while (this->position < this->text.size() && isdigit((unsigned char)(this->text[this->position]))) {
+							this->position += 1;
+						}
+						
+						unsigned long band = (this->position > start) ? std::strtoul(this->text.substr(start, this->position - start).c_str(), nullptr, 10) : 0;
+						if (band == 0 || band > 65535)
+						{
+							this->error = "invalid band reference at position " + std::to_string(start);
+							return;
+						}
+						
+						this->push(Instruction(Opcode::Band, (unsigned int)(band - 1)));
+						this->compiled.highestBand = std::max(this->compiled.highestBand, (unsigned int)(band));
+					}
+					else if (isdigit((unsigned char)(next)) || next == '.')
+					{
+						const char* start = this->text.c_str() + this->position;
+						char* end = nullptr;
+						double value = std::strtod(start, &end);
+						this->position += (size_t)(end - start);
+						if (end == start) {
+							this->error = "invalid number at position " + std::to_string(this->position);
+						}
+						else {
+							this->push(Instruction(Opcode::Constant, 0, value));
+						}
+					}
+					else if (next == '\0') {
+						this->error = "unexpected end of expression";
+					}
+					else {
+						this->error = "unexpected character '" + std::string(1, next) + "'";
+					}
+				}
+				
+				//Skips any whitespace at the current position
+				void skipWhitespace()
+				{
+					while (this->position < this->text.size() && isspace((unsigned char)(this->text[this->position]))) {
+						this->position += 1;
+					}
+				}
+				
+				const std::string& text;
+				size_t position;
+				std::string error;
+				
+			private:
+				
+				//Returns the next non-whitespace character, or '\0' at the end of the expression
+				char peek()
+				{
+					this->skipWhitespace();
+					return (this->position < this->text.size()) ? this->text[this->position] : '\0';
+				}
+				
+				//Appends an instruction that pushes a value onto the stack
+				void push(const Instruction& instruction)
+				{
+					this->compiled.program.push_back(instruction);
+					this->depth += 1;
+					this->compiled.maxDepth = std::max(this->compiled.maxDepth, this->depth);
+				}
+				
+				//Appends a negation, folding it into the preceding instruction if that pushes a constant
+				void emitNegate()
+				{
+					std::vector<Instruction>& program = this->compiled.program;
+					if (program.back().opcode == Opcode::Constant) {
+						program.back().constant = -program.back().constant;
+					}
+					else {
+						program.push_back(Instruction(Opcode::Negate));
+					}
+				}
+				
+				//Appends a binary operation, folding it into a single constant if both of its operands are constants
+				void emitBinary(Opcode opcode)
+				{
+					if (this->error.empty() == false) {
+						return;
+					}
+					
+					std::vector<Instruction>& program = this->compiled.program;
+					size_t size = program.size();
+					this->depth -= 1;
+					if (size >= 2 && program[size - 2].opcode == Opcode::Constant && program[size - 1].opcode == Opcode::Constant)
+					{
+						double lhs = program[size - 2].constant;
+						double rhs = program[size - 1].constant;
+						program.pop_back();
+						program.back().constant = (opcode == Opcode::Add) ? lhs + rhs : (opcode == Opcode::Subtract) ? lhs - rhs : (opcode == Opcode::Multiply) ? lhs * rhs : lhs / rhs;
+					}
+					else {
+						program.push_back(Instruction(opcode));
+					}
+				}
+				
+				int depth;
+				BandExpression& compiled;
+		};
+		
+		//Returns NaN for floating-point types, or zero for integer types
+		template <typename PrimitiveTy>
+		static inline PrimitiveTy notANumber() {
+			return std::numeric_limits<PrimitiveTy>::has_quiet_NaN ? std::numeric_limits<PrimitiveTy>::quiet_NaN() : (PrimitiveTy)(0);
+		}
+		
+		//Combines two registers element-wise, storing the result in the first
+		template <typename OperatorTy>
+		static inline void apply(double* lhs, const double* rhs, uint64_t length, OperatorTy op)
+		{
+			for (uint64_t index = 0; index < length; ++index) {
+				lhs[index] = op(lhs[index], rhs[index]);
+			}
+		}
+		
+		std::string source;
+		std::vector<Instruction> program;
+		int maxDepth;
+		unsigned int highestBand;
+		std::vector<uint8_t> bandHasNoData;
+		std::vector<double> bandNoData;
+		bool outputHasNoData;
+		double outputNoData;
+};
+
+} //End namespace mergetiff
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef _MERGETIFF_BAND_READER_POOL
+#define _MERGETIFF_BAND_READER_POOL
+
+#include "SmartPointers.h"
+
+#include <cpl_error.h>
+#include <gdal.h>
+#include <gdal_priv.h>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mergetiff {
+
+//Provides worker threads with their own GDAL dataset handles for reading a fixed list of raster bands
+//(GDAL dataset handles cannot be used by multiple threads concurrently, so each context reopens the underlying files)
+class BandReaderPool
+{
+	public:
+		
+		//A set of dataset handles that is used by one thread at a time
+		class Context
+		{
+			public:
+				
+				Context() : initialised(false) {}
+				
+				//The reopened raster bands, with nullptr denoting bands that could not be reopened
+				std::vector<GDALRasterBand*> bands;
+				
+				//The datasets that own the reopened raster bands, keyed by filename
+				std::map<std::string, GDALDatasetRef> datasets;
+				
+				bool initialised;
+		};
+		
+		//Creates a pool with the specified number of contexts for reading the supplied raster bands
+		inline BandReaderPool(const std::vector<GDALRasterBand*>& sourceBands, unsigned int numContexts) : sourceBands(sourceBands)
+		{
+			for (unsigned int index = 0; index < numContexts; ++index)
+			{
+				this->contexts.emplace_back(new Context());
+				this->available.push_back(this->contexts.back().get());
+			}
+		}
+		
+		//BandReaderPool objects cannot be copied
+		BandReaderPool(const BandReaderPool& other) = delete;
+		BandReaderPool& operator=(const BandReaderPool& other) = delete;
+		
+		//Returns the number of raster bands that the pool reads from
+		inline size_t numBands() const {
+			return this->sourceBands.size();
+		}
+		
+		//Returns the original raster band with the specified index
+		inline GDALRasterBand* sourceBand(size_t bandIndex) const {
+			return this->sourceBands[bandIndex];
+		}
+		
+		//Acquires exclusive use of a context, blocking until one is available
+		inline Context* acquire()
+		{
+			Context* context = nullptr;
+			
+			{
+				std::unique_lock<std::mutex> lock(this->contextMutex);
+				this->contextAvailable.wait(lock, [this]() { return !this->available.empty(); });
+				context = this->available.back();
+				this->available.pop_back();
+			}
+			
+			//Open the dataset handles for the context the first time it is used
+			if (context->initialised == false) {
+				this->initialise(*context);
+			}
+			
+			return context;
+		}
+		
+		//Returns a previously acquired context to the pool
+		inline void release(Context* context)
+		{
+			{
+				std::lock_guard<std::mutex> lock(this->contextMutex);
+				this->available.push_back(context);
+			}
+			
+			this->contextAvailable.notify_one();
+		}
+		
+		//Reads a window from the specified raster band using the supplied context
+		inline bool read(Context* context, size_t bandIndex, int x, int y, int width, int height, void* buffer, int bufWidth, int bufHeight, GDALDataType bufType, GSpacing pixelSpace, GSpacing lineSpace, GDALRasterIOExtraArg* extraArg = nullptr)
+		{
+			GDALRasterBand* band = context->bands[bandIndex];
+			if (band != nullptr) {
+				return band->RasterIO(GF_Read, x, y, width, height, buffer, bufWidth, bufHeight, bufType, pixelSpace, lineSpace, extraArg) != CE_Failure;
+			}
+			
+			//Bands that could not be reopened are read through the original handle, one thread at a time
+			std::lock_guard<std::mutex> lock(this->sharedMutex);
+			return this->sourceBands[bandIndex]->RasterIO(GF_Read, x, y, width, height, buffer, bufWidth, bufHeight, bufType, pixelSpace, lineSpace, extraArg) != CE_Failure;
+		}
+		
+		//Determines if GDAL reports that a window of the specified raster band contains no data, using the supplied context
+		//(Formats that cannot determine their coverage, such as non-sparse GeoTiffs, are never reported as empty, so only sparse inputs are skipped)
+		inline bool isEmpty(Context* context, size_t bandIndex, int x, int y, int width, int height)
+		{
+			GDALRasterBand* band = context->bands[bandIndex];
+			if (band != nullptr) {
+				return band->GetDataCoverageStatus(x, y, width, height) == GDAL_DATA_COVERAGE_STATUS_EMPTY;
+			}
+			
+			//Bands that could not be reopened are queried through the original handle, one thread at a time
+			std::lock_guard<std::mutex> lock(this->sharedMutex);
+			return this->sourceBands[bandIndex]->GetDataCoverageStatus(x, y, width, height) == GDAL_DATA_COVERAGE_STATUS_EMPTY;
+		}
+		
+		//Reads a window from all of the raster bands with a single dataset-level read using the supplied context
+		//(All of the raster bands must belong to the same dataset, which allows GDAL to decode each pixel-interleaved block once for all of the bands)
+		inline bool readAllBands(Context* context, int x, int y, int width, int height, void* buffer, GDALDataType bufType, GSpacing pixelSpace, GSpacing lineSpace, GSpacing bandSpace)
+		{
+			std::vector<int> bandMap;
+			for (auto sourceBand : this->sourceBands) {
+				bandMap.push_back(sourceBand->GetBand());
+			}
+			
+			GDALDataset* dataset = (context->bands[0] != nullptr) ? context->bands[0]->GetDataset() : nullptr;
+			if (dataset != nullptr) {
+				return dataset->RasterIO(GF_Read, x, y, width, height, buffer, width, height, bufType, (int)(bandMap.size()), bandMap.data(), pixelSpace, lineSpace, bandSpace, nullptr) != CE_Failure;
+			}
+			
+			//Datasets that could not be reopened are read through the original handle, one thread at a time
+			std::lock_guard<std::mutex> lock(this->sharedMutex);
+			dataset = this->sourceBands[0]->GetDataset();
+			return dataset->RasterIO(GF_Read, x, y, width, height, buffer, width, height, bufType, (int)(bandMap.size()), bandMap.data(), pixelSpace, lineSpace, bandSpace, nullptr) != CE_Failure;
+		}
+		
+	private:
+		
+		//Reopens the datasets for each of the source raster bands
+		inline void initialise(Context& context)
+		{
+			//Suppress the error messages generated by datasets that cannot be reopened (e.g. in-memory datasets)
+			CPLPushErrorHandler(CPLQuietErrorHandler);
+			
+			for (auto sourceBand : this->sourceBands)
+			{
+				GDALRasterBand* band = nullptr;
+				GDALDataset* sourceDataset = sourceBand->GetDataset();
+				std::string path = (sourceDataset != nullptr) ? sourceDataset->GetDescription() : "";
+				
+				//Datasets opened for writing may have modifications in the block cache that have not yet reached the file, so they are never reopened
+				bool writable = (sourceDataset != nullptr && sourceDataset->GetAccess() == GA_Update);
+				if (path.empty() == false && writable == false)
+				{
+					//Only open each file once per context
+					auto existing = context.datasets.find(path);
+					if (existing == context.datasets.end())
+					{
+						GDALDataset* dataset = (GDALDataset*)(GDALOpenEx(path.c_str(), GDAL_OF_RASTER | GDAL_OF_READONLY, nullptr, nullptr, nullptr));
+						existing = context.datasets.insert(std::make_pair(path, GDALDatasetRef(dataset))).first;
+					}
+					
+					//Verify that the reopened dataset matches the original before using it
+					GDALDataset* dataset = MERGETIFF_SMART_POINTER_GET(existing->second);
+					if (dataset != nullptr &&
+						dataset->GetRasterXSize() == sourceDataset->GetRasterXSize() &&
+						dataset->GetRasterYSize() == sourceDataset->GetRasterYSize() &&
+						sourceBand->GetBand() >= 1 &&
+						sourceBand->GetBand() <= dataset->GetRasterCount() &&
+						dataset->GetRasterBand(sourceBand->GetBand())->GetRasterDataType() == sourceBand->GetRasterDataType())
+					{
+						band = dataset->GetRasterBand(sourceBand->GetBand());
+					}
+				}
+				
+				context.bands.push_back(band);
+			}
+			
+			CPLPopErrorHandler();
+			context.initialised = true;
+		}
+		
+		std::vector<GDALRasterBand*> sourceBands;
+		std::vector< std::unique_ptr<Context> > contexts;
+		std::vector<Context*> available;
+		std::mutex contextMutex;
+		std::condition_variable contextAvailable;
+		std::mutex sharedMutex;
+};
+
+} //End namespace mergetiff
+
+#endif
@@ -0,0 +1,395 @@
+#ifndef _MERGETIFF_BAND_STATISTICS
+#define _MERGETIFF_BAND_STATISTICS
+
+#include "DatatypeConversion.h"
+#include "RasterView.h"
+
+#include <gdal_priv.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace mergetiff {
+
+//The summary statistics and histogram of the valid pixels of a raster band, equivalent to those computed by `gdalinfo -stats -hist`
+//(Pixels that contain the band's "no data" value are not valid, and nor are NaN pixels of floating-point bands)
+class BandStatistics
+{
+	public:
+		
+		BandStatistics() :
+			pixels(0),
+			validPixels(0),
+			minimum(0.0),
+			maximum(0.0),
+			mean(0.0),
+			stddev(0.0),
+			histogramMin(0.0),
+			histogramMax(0.0)
+		{}
+		
+		//Determines if the band contained any valid pixels
+		bool valid() const {
+			return this->validPixels > 0;
+		}
+		
+		//Stores the statistics in the metadata of a raster band, along with the histogram if there is one
+		//(GDAL writes the statistics to the band metadata of formats that support it, and anything else to the dataset's .aux.xml file when it is closed)
+		bool writeToBand(GDALRasterBand* band) const
+		{
+			if (band == nullptr || this->valid() == false) {
+				return false;
+			}
+			
+			double validPercent = 100.0 * (double)(this->validPixels) / (double)(this->pixels);
+			bool success = band->SetStatistics(this->minimum, this->maximum, this->mean, this->stddev) != CE_Failure;
+			success = success && band->SetMetadataItem("STATISTICS_VALID_PERCENT", std::to_string(validPercent).c_str()) != CE_Failure;
+			if (success && this->histogram.empty() == false)
+			{
+				std::vector<GUIntBig> buckets(this->histogram.begin(), this->histogram.end());
+				success = band->SetDefaultHistogram(this->histogramMin, this->histogramMax, (int)(buckets.size()), buckets.data()) != CE_Failure;
+			}
+			
+			return success;
+		}
+		
+		//The total number of pixels examined, and the number of those that were valid
+		uint64_t pixels;
+		uint64_t validPixels;
+		
+		//The statistics of the valid pixels (the standard deviation is that of the population, as computed by GDAL)
+		double minimum;
+		double maximum;
+		double mean;
+		double stddev;
+		
+		//The histogram of the valid pixels, whose buckets evenly divide the range [histogramMin, histogramMax]
+		//(Histograms are only computed for 8-bit and 16-bit integer bands, whose values can be counted exactly without knowing their range in advance)
+		double histogramMin;
+		double histogramMax;
+		std::vector<uint64_t> histogram;
+};
+
+//Accumulates the statistics of a raster band one block at a time, so that they can be computed from blocks that are already in memory
+//(Separate accumulators can be used for blocks that are processed concurrently, and then merged once every block has been processed)
+template <typename PrimitiveTy>
+class BandStatisticsAccumulator
+{
+	public:
+		
+		//Whether values are counted into an exact histogram with one bin per representable value, from which every statistic is then derived
+		static const bool Binned = std::is_integral<PrimitiveTy>::value && sizeof(PrimitiveTy) <= 2;
+		
+		//The number of buckets in the histograms that are produced
+		static const int HistogramBuckets = 256;
+		
+		//Creates an empty accumulator for a band with the specified "no data" value, if any
+		BandStatisticsAccumulator(int hasNoData = 0, double noDataValue = 0.0) :
+			excludeNoData(false),
+			noDataValue(DatatypeConversion::saturate<PrimitiveTy>(std::isnan(noDataValue) ? 0.0 : noDataValue)),
+			pixels(0),
+			count(0),
+			minimum(std::numeric_limits<double>::infinity()),
+			maximum(-std::numeric_limits<double>::infinity()),
+			mean(0.0),
+			m2(0.0)
+		{
+			//A "no data" value outside the range of the datatype (or that an integer type cannot represent exactly) never matches any pixels,
+			//and NaN pixels are always excluded from floating-point bands
+			bool inRange = (noDataValue >= (double)(std::numeric_limits<PrimitiveTy>::lowest()) && noDataValue <= (double)(std::numeric_limits<PrimitiveTy>::max()));
+			bool representable = std::is_floating_point<PrimitiveTy>::value ? inRange : ((double)(this->noDataValue) == noDataValue);
+			this->excludeNoData = (hasNoData != 0 && std::isnan(noDataValue) == false && representable);
+			this->bins.resize(BandStatisticsAccumulator::numBins() * BandStatisticsAccumulator::numLanes(), 0);
+		}
+		
+		//Returns the memory used by each accumulator in bytes
+		static inline uint64_t bytes() {
+			return sizeof(BandStatisticsAccumulator) + (BandStatisticsAccumulator::numBins() * BandStatisticsAccumulator::numLanes() * sizeof(uint64_t));
+		}
+		
+		//Computes the statistics for a single channel of a raster view
+		static inline BandStatistics compute(const RasterView<PrimitiveTy>& view, uint64_t channel, int hasNoData, double noDataValue)
+		{
+			BandStatisticsAccumulator accumulator(hasNoData, noDataValue);
+			accumulator.add(view, channel);
+			return accumulator.finish();
+		}
+		
+		//Accumulates the values of a single channel of a raster view
+		void add(const RasterView<PrimitiveTy>& view, uint64_t channel)
+		{
+			//Channels whose rows are stored contiguously are accumulated in a single pass
+			if (view.pixelSpacing() == 1 && view.lineSpacing() == view.cols())
+			{
+				this->add(&(view.pixelComponent(0, 0, channel)), view.rows() * view.cols());
+				return;
+			}
+			
+			for (uint64_t row = 0; row < view.rows(); ++row) {
+				this->add(&(view.pixelComponent(row, 0, channel)), view.cols(), view.pixelSpacing());
+			}
+		}
+		
+		//Accumulates the specified number of values, which are spaced the specified number of elements apart
+		void add(const PrimitiveTy* values, uint64_t numValues, uint64_t stride = 1)
+		{
+			this->pixels += numValues;
+			if (Binned == true) {
+				this->addBinned(values, numValues, stride);
+			}
+			else if (stride == 1) {
+				this->addSummary(values, numValues, 1);
+			}
+			else {
+				this->addSummary(values, numValues, stride);
+			}
+		}
+		
+		//Merges the values accumulated by another accumulator for the same band into this one
+		void merge(const BandStatisticsAccumulator& other)
+		{
+			this->pixels += other.pixels;
+			for (size_t bin = 0; bin < this->bins.size(); ++bin) {
+				this->bins[bin] += other.bins[bin];
+			}
+			
+			this->minimum = std::min(this->minimum, other.minimum);
+			this->maximum = std::max(this->maximum, other.maximum);
+			this->combine(other.count, other.mean, other.m2);
+		}
+		
+		//Computes the statistics of all of the values that have been accumulated
+		BandStatistics finish() const
+		{
+			BandStatistics stats;
+			stats.pixels = this->pixels;
+			if (Binned == false)
+			{
+				stats.validPixels = this->count;
+				if (this->count > 0)
+				{
+					stats.minimum = this->minimum;
+					stats.maximum = this->maximum;
+					stats.mean = this->mean;
+					stats.stddev = std::sqrt(this->m2 / (double)(this->count));
+				}
+				
+				return stats;
+			}
+			
+			//Fold the lanes of bins together, discarding the bin of the "no data" value
+			const uint64_t numBins = BandStatisticsAccumulator::numBins();
+			std::vector<uint64_t> counts(this->bins.begin(), this->bins.begin() + numBins);
+			for (uint64_t lane = 1; lane < BandStatisticsAccumulator::numLanes(); ++lane)
+			{
+				for (uint64_t bin = 0; bin < numBins; ++bin) {
+					counts[bin] += this->bins[(lane * numBins) + bin];
+				}
+			}
+			if (this->excludeNoData == true) {
+				counts[BandStatisticsAccumulator::bin(this->noDataValue)] = 0;
+			}
+			
+			//Compute the range and mean from the bin counts, then the variance about the mean
+			double sum = 0.0;
+			uint64_t first = numBins;
+			uint64_t last = 0;
+			for (uint64_t bin = 0; bin < numBins; ++bin)
+			{
+				if (counts[bin] > 0)
+				{
+					first = std::min(first, bin);
+					last = bin;
+					stats.validPixels += counts[bin];
+					sum += (double)(counts[bin]) * BandStatisticsAccumulator::binValue(bin);
+				}
+			}
+			if (stats.validPixels == 0) {
+				return stats;
+			}
+			
+			stats.minimum = BandStatisticsAccumulator::binValue(first);
+			stats.maximum = BandStatisticsAccumulator::binValue(last);
+			stats.mean = sum / (double)(stats.validPixels);
+			double squares = 0.0;
+			for (uint64_t bin = first; bin <= last; ++bin)
+			{
+				double deviation = BandStatisticsAccumulator::binValue(bin) - stats.mean;
+				squares += (double)(counts[bin]) * deviation * deviation;
+			}
+			stats.stddev = std::sqrt(squares / (double)(stats.validPixels));
+			
+			//8-bit histograms have one bucket per value, and wider histograms span the range of the values with a half-bucket margin, as GDAL's do
+			if (sizeof(PrimitiveTy) == 1)
+			{
+				stats.histogramMin = BandStatisticsAccumulator::binValue(0) - 0.5;
+				stats.histogramMax = BandStatisticsAccumulator::binValue(numBins - 1) + 0.5;
+			}
+			else
+			{
+				double margin = (stats.maximum > stats.minimum) ? (stats.maximum - stats.minimum) / (2.0 * (HistogramBuckets - 1)) : 0.5;
+				stats.histogramMin = stats.minimum - margin;
+				stats.histogramMax = stats.maximum + margin;
+			}
+			
+			stats.histogram.resize(HistogramBuckets, 0);
+			double scale = (double)(HistogramBuckets) / (stats.histogramMax - stats.histogramMin);
+			for (uint64_t bin = first; bin <= last; ++bin)
+			{
+				int bucket = (int)((BandStatisticsAccumulator::binValue(bin) - stats.histogramMin) * scale);
+				stats.histogram[std::min(std::max(bucket, 0), HistogramBuckets - 1)] += counts[bin];
+			}
+			
+			return stats;
+		}
+		
+	private:
+		
+		//Returns the number of bins used for each lane of an exact histogram (zero for types that are not binned)
+		static inline uint64_t numBins() {
+			return (Binned == true) ? ((uint64_t)(1) << (8 * std::min<size_t>(sizeof(PrimitiveTy), 2))) : 0;
+		}
+		
+		//Returns the number of separate sets of bins that are counted into and later folded together
+		//(8-bit values are counted into four sets of bins, so that runs of identical values do not serialise on the same counter)
+		static inline uint64_t numLanes() {
+			return (sizeof(PrimitiveTy) == 1) ? 4 : 1;
+		}
+		
+		//Returns the bin that counts the specified value
+		static inline uint64_t bin(PrimitiveTy value) {
+			return (uint64_t)((int64_t)(value) - (int64_t)(std::numeric_limits<PrimitiveTy>::lowest()));
+		}
+		
+		//Returns the value that the specified bin counts
+		static inline double binValue(uint64_t bin) {
+			return (double)(std::numeric_limits<PrimitiveTy>::lowest()) + (double)(bin);
+		}
+		
+		//Counts each of the values into its bin
+		void addBinned(const PrimitiveTy* values, uint64_t numValues, uint64_t stride)
+		{
+			const uint64_t numBins = BandStatisticsAccumulator::numBins();
+			uint64_t* bins = this->bins.data();
+			uint64_t index = 0;
+			if (BandStatisticsAccumulator::numLanes() == 4)
+			{
+				for (; index + 4 <= numValues; index += 4)
+				{
+					bins[BandStatisticsAccumulator::bin(values[index * stride])] += 1;
+					bins[numBins + BandStatisticsAccumulator::bin(values[(index + 1) * stride])] += 1;
+					bins[(2 * numBins) + BandStatisticsAccumulator::bin(values[(index + 2) * stride])] += 1;
+					bins[(3 * numBins) + BandStatisticsAccumulator::bin(values[(index + 3) * stride])] += 1;
+				}
+			}
+			
+			for (; index < numValues; ++index) {
+				bins[BandStatisticsAccumulator::bin(values[index * stride])] += 1;
+			}
+		}
+		
+		//Accumulates the count, range, mean and sum of squared deviations of the valid values
+		//(Each value is masked rather than branched on, and four independent sets of partial results break the dependency between iterations,
+		// so the compiler can vectorise the loop. The values are summed relative to the first valid value to avoid catastrophic cancellation.)
+		void addSummary(const PrimitiveTy* values, uint64_t numValues, uint64_t stride)
+		{
+			//Find the first valid value, which is the reference point for the block
+			uint64_t start = 0;
+			while (start < numValues && this->isValid(values[start * stride]) == false) {
+				start += 1;
+			}
+			if (start == numValues) {
+				return;
+			}
+			
+			const double reference = (double)(values[start * stride]);
+			double counts[4] = {0.0, 0.0, 0.0, 0.0};
+			double sums[4] = {0.0, 0.0, 0.0, 0.0};
+			double squares[4] = {0.0, 0.0, 0.0, 0.0};
+			double minima[4] = {reference, reference, reference, reference};
+			double maxima[4] = {reference, reference, reference, reference};
+			uint64_t index = start;
+			for (; index + 4 <= numValues; index += 4)
+			{
+				for (int lane = 0; lane < 4; ++lane)
+				{
+					PrimitiveTy value = values[(index + lane) * stride];
+					bool valid = this->isValid(value);
+					double deviation = valid ? (double)(value) - reference : 0.0;
+					counts[lane] += valid ? 1.0 : 0.0;
+					sums[lane] += deviation;
+					squares[lane] += deviation * deviation;
+					minima[lane] = valid ? std::min(minima[lane], (double)(value)) : minima[lane];
+					maxima[lane] = valid ? std::max(maxima[lane], (double)(value)) : maxima[lane];
+				}
+			}
+			
+			for (; index < numValues; ++index)
+			{
+				PrimitiveTy value = values[index * stride];
+				if (this->isValid(value) == true)
+				{
+					double deviation = (double)(value) - reference;
+					counts[0] += 1.0;
+					sums[0] += deviation;
+					squares[0] += deviation * deviation;
+					minima[0] = std::min(minima[0], (double)(value));
+					maxima[0] = std::max(maxima[0], (double)(value));
+				}
+			}
+			
+			//Combine the partial results for the block with the values accumulated so far
+			double blockCount = counts[0] + counts[1] + counts[2] + counts[3];
+			double blockSum = sums[0] + sums[1] + sums[2] + sums[3];
+			double blockSquares = squares[0] + squares[1] + squares[2] + squares[3];
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				this->minimum = std::min(this->minimum, minima[lane]);
+				this->maximum = std::max(this->maximum, maxima[lane]);
+			}
+			
+			double blockMean = blockSum / blockCount;
+			this->combine((uint64_t)(blockCount), reference + blockMean, std::max(0.0, blockSquares - (blockSum * blockMean)));
+		}
+		
+		//Determines if a value is valid, i.e. it is neither the "no data" value nor NaN
+		inline bool isValid(PrimitiveTy value) const {
+			return value == value && (this->excludeNoData == false || value != this->noDataValue);
+		}
+		
+		//Combines the count, mean and sum of squared deviations of another set of values with those accumulated so far
+		void combine(uint64_t otherCount, double otherMean, double otherM2)
+		{
+			if (otherCount == 0) {
+				return;
+			}
+			
+			double total = (double)(this->count + otherCount);
+			double delta = otherMean - this->mean;
+			this->mean += delta * ((double)(otherCount) / total);
+			this->m2 += otherM2 + (delta * delta * ((double)(this->count) * (double)(otherCount) / total));
+			this->count += otherCount;
+		}
+		
+		bool excludeNoData;
+		PrimitiveTy noDataValue;
+		uint64_t pixels;
+		
+		//The exact histogram used for binned types
+		std::vector<uint64_t> bins;
+		
+		//The running statistics used for all other types
+		uint64_t count;
+		double minimum;
+		double maximum;
+		double mean;
+		double m2;
+};
+
+} //End namespace mergetiff
+
+#endif
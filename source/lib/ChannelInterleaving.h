@@ -0,0 +1,277 @@
+#ifndef _MERGETIFF_CHANNEL_INTERLEAVING
+#define _MERGETIFF_CHANNEL_INTERLEAVING
+
+#include "LibrarySettings.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstddef>
+
+//Use the SSE2 kernels whenever SSE2 is available (it is always available on x86-64), unless the user has disabled them
+#if !defined(MERGETIFF_DISABLE_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define _MERGETIFF_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace mergetiff {
+
+//Kernels for converting between separate channel planes and pixel-interleaved buffers
+//(Whole pixels of 2, 4 or 8 channels are shuffled with SSE2 unpack instructions, which only move bits and are therefore selected by the size of the
+// primitive type rather than the type itself. Other channel counts use loops whose channel count is a compile-time constant where it is common.)
+class ChannelInterleaving
+{
+	public:
+		
+		//Interleaves the specified number of pixels from separate planes into consecutive channels of a buffer whose pixels are the specified number of elements apart,
+		//such that `dest[(pixel * destStride) + plane] = planes[plane][pixel]` (channels of the destination that have no corresponding plane are left untouched)
+		template <typename PrimitiveTy>
+		static inline void interleave(const PrimitiveTy* const* planes, uint64_t numPlanes, PrimitiveTy* dest, uint64_t destStride, uint64_t count)
+		{
+			//Use the specialised kernels when the planes make up complete pixels
+			if (numPlanes == destStride)
+			{
+				switch (numPlanes)
+				{
+					case 1:
+						std::copy(planes[0], planes[0] + count, dest);
+						return;
+					
+					case 2:
+						ChannelInterleaving::interleavePixels<PrimitiveTy, 2>(planes, dest, count);
+						return;
+					
+					case 3:
+						ChannelInterleaving::interleavePixels<PrimitiveTy, 3>(planes, dest, count);
+						return;
+					
+					case 4:
+						ChannelInterleaving::interleavePixels<PrimitiveTy, 4>(planes, dest, count);
+						return;
+					
+					case 8:
+						ChannelInterleaving::interleavePixels<PrimitiveTy, 8>(planes, dest, count);
+						return;
+					
+					default:
+						break;
+				}
+			}
+			
+			for (uint64_t plane = 0; plane < numPlanes; ++plane)
+			{
+				const PrimitiveTy* source = planes[plane];
+				PrimitiveTy* channel = dest + plane;
+				for (uint64_t pixel = 0; pixel < count; ++pixel) {
+					channel[pixel * destStride] = source[pixel];
+				}
+			}
+		}
+		
+		//Deinterleaves the specified number of pixels from consecutive channels of a buffer whose pixels are the specified number of elements apart into separate planes,
+		//such that `planes[plane][pixel] = source[(pixel * sourceStride) + plane]`
+		template <typename PrimitiveTy>
+		static inline void deinterleave(const PrimitiveTy* source, uint64_t sourceStride, PrimitiveTy* const* planes, uint64_t numPlanes, uint64_t count)
+		{
+			//Use the specialised kernels when the planes make up complete pixels
+			if (numPlanes == sourceStride)
+			{
+				switch (numPlanes)
+				{
+					case 1:
+						std::copy(source, source + count, planes[0]);
+						return;
+					
+					case 2:
+						ChannelInterleaving::deinterleavePixels<PrimitiveTy, 2>(source, planes, count);
+						return;
+					
+					case 3:
+						ChannelInterleaving::deinterleavePixels<PrimitiveTy, 3>(source, planes, count);
+						return;
+					
+					case 4:
+						ChannelInterleaving::deinterleavePixels<PrimitiveTy, 4>(source, planes, count);
+						return;
+					
+					case 8:
+						ChannelInterleaving::deinterleavePixels<PrimitiveTy, 8>(source, planes, count);
+						return;
+					
+					default:
+						break;
+				}
+			}
+			
+			for (uint64_t plane = 0; plane < numPlanes; ++plane)
+			{
+				const PrimitiveTy* channel = source + plane;
+				PrimitiveTy* dest = planes[plane];
+				for (uint64_t pixel = 0; pixel < count; ++pixel) {
+					dest[pixel] = channel[pixel * sourceStride];
+				}
+			}
+		}
+		
+	private:
+		
+		//Interleaves complete pixels with a compile-time channel count, using the SSE2 kernels for as many pixels as possible
+		template <typename PrimitiveTy, unsigned int Channels>
+		static inline void interleavePixels(const PrimitiveTy* const* planes, PrimitiveTy* dest, uint64_t count)
+		{
+			uint64_t pixel = 0;
+			
+			#if defined(_MERGETIFF_USE_SSE2)
+			pixel = SimdKernels<sizeof(PrimitiveTy), Channels>::interleave((const void* const*)(planes), (void*)(dest), count);
+			#endif
+			
+			for (; pixel < count; ++pixel)
+			{
+				for (unsigned int channel = 0; channel < Channels; ++channel) {
+					dest[(pixel * Channels) + channel] = planes[channel][pixel];
+				}
+			}
+		}
+		
+		//Deinterleaves complete pixels with a compile-time channel count, using the SSE2 kernels for as many pixels as possible
+		template <typename PrimitiveTy, unsigned int Channels>
+		static inline void deinterleavePixels(const PrimitiveTy* source, PrimitiveTy* const* planes, uint64_t count)
+		{
+			uint64_t pixel = 0;
+			
+			#if defined(_MERGETIFF_USE_SSE2)
+			pixel = SimdKernels<sizeof(PrimitiveTy), Channels>::deinterleave((const void*)(source), (void* const*)(planes), count);
+			#endif
+			
+			for (; pixel < count; ++pixel)
+			{
+				for (unsigned int channel = 0; channel < Channels; ++channel) {
+					planes[channel][pixel] = source[(pixel * Channels) + channel];
+				}
+			}
+		}
+		
+		#if defined(_MERGETIFF_USE_SSE2)
+		
+		//Interleaves the elements of two registers, for elements of the specified size in bytes
+		template <size_t ElementSize> static inline __m128i unpackLo(__m128i a, __m128i b);
+		template <size_t ElementSize> static inline __m128i unpackHi(__m128i a, __m128i b);
+		
+		//Performs a perfect shuffle of a group of registers, treating them as a single sequence of elements
+		//(Each shuffle rotates the bits of every element's index within the group left by one, so interleaving N planes takes log2(N) shuffles
+		// and deinterleaving them takes log2(elements per register) shuffles, since together these rotate the index bits by the whole index width)
+		template <size_t ElementSize, unsigned int Registers>
+		static inline void perfectShuffle(__m128i* registers)
+		{
+			__m128i shuffled[Registers];
+			for (unsigned int index = 0; index < Registers / 2; ++index)
+			{
+				shuffled[(index * 2)] = ChannelInterleaving::unpackLo<ElementSize>(registers[index], registers[index + (Registers / 2)]);
+				shuffled[(index * 2) + 1] = ChannelInterleaving::unpackHi<ElementSize>(registers[index], registers[index + (Registers / 2)]);
+			}
+			
+			for (unsigned int index = 0; index < Registers; ++index) {
+				registers[index] = shuffled[index];
+			}
+		}
+		
+		//The SSE2 kernels for a given element size and channel count, each of which returns the number of pixels it processed
+		//(Channel counts that are not a power of two have no SSE2 kernel, since shuffling them requires SSSE3 byte shuffles)
+		template <size_t ElementSize, unsigned int Channels>
+		struct SimdKernels
+		{
+			static inline uint64_t interleave(const void* const*, void*, uint64_t) {
+				return 0;
+			}
+			
+			static inline uint64_t deinterleave(const void*, void* const*, uint64_t) {
+				return 0;
+			}
+		};
+		
+		template <size_t ElementSize, unsigned int Channels, unsigned int Log2Channels>
+		struct PowerOfTwoKernels
+		{
+			//The number of pixels processed by each iteration, which fill one register per channel
+			static const uint64_t PixelsPerStep = 16 / ElementSize;
+			
+			static inline uint64_t interleave(const void* const* planes, void* dest, uint64_t count)
+			{
+				uint64_t pixel = 0;
+				__m128i registers[Channels];
+				for (; pixel + PixelsPerStep <= count; pixel += PixelsPerStep)
+				{
+					for (unsigned int channel = 0; channel < Channels; ++channel) {
+						registers[channel] = _mm_loadu_si128((const __m128i*)((const uint8_t*)(planes[channel]) + (pixel * ElementSize)));
+					}
+					
+					for (unsigned int round = 0; round < Log2Channels; ++round) {
+						ChannelInterleaving::perfectShuffle<ElementSize, Channels>(registers);
+					}
+					
+					uint8_t* output = (uint8_t*)(dest) + (pixel * ElementSize * Channels);
+					for (unsigned int index = 0; index < Channels; ++index) {
+						_mm_storeu_si128((__m128i*)(output + (index * 16)), registers[index]);
+					}
+				}
+				
+				return pixel;
+			}
+			
+			static inline uint64_t deinterleave(const void* source, void* const* planes, uint64_t count)
+			{
+				uint64_t pixel = 0;
+				__m128i registers[Channels];
+				for (; pixel + PixelsPerStep <= count; pixel += PixelsPerStep)
+				{
+					const uint8_t* input = (const uint8_t*)(source) + (pixel * ElementSize * Channels);
+					for (unsigned int index = 0; index < Channels; ++index) {
+						registers[index] = _mm_loadu_si128((const __m128i*)(input + (index * 16)));
+					}
+					
+					for (uint64_t elements = PixelsPerStep; elements > 1; elements /= 2) {
+						ChannelInterleaving::perfectShuffle<ElementSize, Channels>(registers);
+					}
+					
+					for (unsigned int channel = 0; channel < Channels; ++channel) {
+						_mm_storeu_si128((__m128i*)((uint8_t*)(planes[channel]) + (pixel * ElementSize)), registers[channel]);
+					}
+				}
+				
+				return pixel;
+			}
+		};
+		
+		#endif
+};
+
+#if defined(_MERGETIFF_USE_SSE2)
+
+template <> inline __m128i ChannelInterleaving::unpackLo<1>(__m128i a, __m128i b) { return _mm_unpacklo_epi8(a, b); }
+template <> inline __m128i ChannelInterleaving::unpackLo<2>(__m128i a, __m128i b) { return _mm_unpacklo_epi16(a, b); }
+template <> inline __m128i ChannelInterleaving::unpackLo<4>(__m128i a, __m128i b) { return _mm_unpacklo_epi32(a, b); }
+template <> inline __m128i ChannelInterleaving::unpackLo<8>(__m128i a, __m128i b) { return _mm_unpacklo_epi64(a, b); }
+template <> inline __m128i ChannelInterleaving::unpackHi<1>(__m128i a, __m128i b) { return _mm_unpackhi_epi8(a, b); }
+template <> inline __m128i ChannelInterleaving::unpackHi<2>(__m128i a, __m128i b) { return _mm_unpackhi_epi16(a, b); }
+template <> inline __m128i ChannelInterleaving::unpackHi<4>(__m128i a, __m128i b) { return _mm_unpackhi_epi32(a, b); }
+template <> inline __m128i ChannelInterleaving::unpackHi<8>(__m128i a, __m128i b) { return _mm_unpackhi_epi64(a, b); }
+
+#define _MERGETIFF_SIMD_KERNEL_SPECIALISATION(ElementSize, Channels, Log2Channels) template <> struct ChannelInterleaving::SimdKernels<ElementSize, Channels> : public ChannelInterleaving::PowerOfTwoKernels<ElementSize, Channels, Log2Channels> {};
+_MERGETIFF_SIMD_KERNEL_SPECIALISATION(1, 2, 1)
+_MERGETIFF_SIMD_KERNEL_SPECIALISATION(2, 2, 1)
+_MERGETIFF_SIMD_KERNEL_SPECIALISATION(4, 2, 1)
+_MERGETIFF_SIMD_KERNEL_SPECIALISATION(8, 2, 1)
+_MERGETIFF_SIMD_KERNEL_SPECIALISATION(1, 4, 2)
+_MERGETIFF_SIMD_KERNEL_SPECIALISATION(2, 4, 2)
+_MERGETIFF_SIMD_KERNEL_SPECIALISATION(4, 4, 2)
+_MERGETIFF_SIMD_KERNEL_SPECIALISATION(8, 4, 2)
+_MERGETIFF_SIMD_KERNEL_SPECIALISATION(1, 8, 3)
+_MERGETIFF_SIMD_KERNEL_SPECIALISATION(2, 8, 3)
+_MERGETIFF_SIMD_KERNEL_SPECIALISATION(4, 8, 3)
+_MERGETIFF_SIMD_KERNEL_SPECIALISATION(8, 8, 3)
+#undef _MERGETIFF_SIMD_KERNEL_SPECIALISATION
+
+#endif
+
+} //End namespace mergetiff
+
+#endif
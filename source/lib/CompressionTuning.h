@@ -0,0 +1,172 @@
+#ifndef _MERGETIFF_COMPRESSION_TUNING
+#define _MERGETIFF_COMPRESSION_TUNING
+
+#include "ArgsArray.h"
+#include "DriverOptions.h"
+#include "RasterWindow.h"
+
+#include <cpl_error.h>
+#include <cpl_vsi.h>
+#include <gdal.h>
+#include <gdal_priv.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace mergetiff {
+
+//Selects a compression profile for the CompressionCodec::Auto codec by compressing a sample of tiles with each candidate
+class CompressionTuning
+{
+	public:
+		
+		//The results of compressing the sample tiles with a candidate profile
+		class Measurement
+		{
+			public:
+				
+				Measurement() : success(false), encodeSeconds(0.0), decodeSeconds(0.0), compressedBytes(0) {}
+				
+				bool success;
+				double encodeSeconds;
+				double decodeSeconds;
+				uint64_t compressedBytes;
+		};
+		
+		//Returns the supplied profile unchanged, unless its codec is CompressionCodec::Auto,
+		//in which case the candidate that best suits the profile's target for the supplied bands is returned
+		static inline CompressionProfile resolve(const CompressionProfile& profile, const std::vector<GDALRasterBand*>& bands, GDALDataType dtype, unsigned int blockSize, unsigned int numSamples = 4)
+		{
+			if (profile.codec != CompressionCodec::Auto || bands.empty()) {
+				return profile;
+			}
+			
+			//Read the sample tiles and measure each of the candidates (codecs that GDAL was built without simply fail)
+			std::vector<uint8_t> samples;
+			unsigned int sampleCount = CompressionTuning::readSamples(bands, dtype, blockSize, numSamples, samples);
+			CompressionProfile best(CompressionCodec::LZW);
+			double bestCost = -1.0;
+			for (auto& candidate : CompressionTuning::candidates())
+			{
+				Measurement measurement = CompressionTuning::measure(candidate, samples, (int)(bands.size()), dtype, blockSize, sampleCount);
+				double cost = CompressionTuning::cost(measurement, profile.target);
+				if (measurement.success && (bestCost < 0.0 || cost < bestCost))
+				{
+					best = candidate;
+					bestCost = cost;
+				}
+			}
+			
+			best.target = profile.target;
+			return best;
+		}
+		
+		//Returns the lossless profiles that are considered by the automatic selection
+		static inline std::vector<CompressionProfile> candidates()
+		{
+			return std::vector<CompressionProfile>({
+				CompressionProfile(CompressionCodec::None),
+				CompressionProfile(CompressionCodec::LZW),
+				CompressionProfile(CompressionCodec::Deflate, 1),
+				CompressionProfile(CompressionCodec::Deflate, 6),
+				CompressionProfile(CompressionCodec::ZSTD, 1),
+				CompressionProfile(CompressionCodec::ZSTD, 9)
+			});
+		}
+		
+		//Compresses the sample tiles to an in-memory GeoTiff with the specified profile, then reads them back
+		//(The samples are stored band-sequentially, with the tiles of each band stacked vertically)
+		static inline Measurement measure(const CompressionProfile& profile, const std::vector<uint8_t>& samples, int numBands, GDALDataType dtype, unsigned int blockSize, unsigned int sampleCount)
+		{
+			Measurement measurement;
+			GDALDriver* tiffDriver = ((GDALDriver*)GDALGetDriverByName("GTiff"));
+			if (tiffDriver == nullptr || sampleCount == 0) {
+				return measurement;
+			}
+			
+			ArgsArray options = DriverOptions::geoTiffOptions(dtype, profile);
+			options.add("TILED=YES");
+			options.add("BLOCKXSIZE=" + std::to_string(blockSize));
+			options.add("BLOCKYSIZE=" + std::to_string(blockSize));
+			
+			//Compress the samples, including the time taken to flush the tiles when the dataset is closed
+			std::string filename = "/vsimem/mergetiff_tuning_" + std::to_string((uintptr_t)(samples.data())) + "_" + profile.name() + ".tif";
+			int height = (int)(blockSize * sampleCount);
+			CPLPushErrorHandler(CPLQuietErrorHandler);
+			auto start = std::chrono::steady_clock::now();
+			GDALDataset* dataset = tiffDriver->Create(filename.c_str(), blockSize, height, numBands, dtype, options.get());
+			measurement.success = dataset != nullptr &&
+				dataset->RasterIO(GF_Write, 0, 0, blockSize, height, (void*)(samples.data()), blockSize, height, dtype, numBands, nullptr, 0, 0, 0, nullptr) != CE_Failure;
+			if (dataset != nullptr) {
+				GDALClose(dataset);
+			}
+			auto encoded = std::chrono::steady_clock::now();
+			
+			//Decompress the samples
+			if (measurement.success == true)
+			{
+				std::vector<uint8_t> decodedSamples(samples.size());
+				dataset = (GDALDataset*)(GDALOpen(filename.c_str(), GA_ReadOnly));
+				measurement.success = dataset != nullptr &&
+					dataset->RasterIO(GF_Read, 0, 0, blockSize, height, decodedSamples.data(), blockSize, height, dtype, numBands, nullptr, 0, 0, 0, nullptr) != CE_Failure;
+				if (dataset != nullptr) {
+					GDALClose(dataset);
+				}
+			}
+			auto decoded = std::chrono::steady_clock::now();
+			
+			VSIStatBufL stats;
+			if (measurement.success == true && VSIStatL(filename.c_str(), &stats) == 0) {
+				measurement.compressedBytes = stats.st_size;
+			}
+			
+			VSIUnlink(filename.c_str());
+			CPLPopErrorHandler();
+			
+			measurement.encodeSeconds = std::chrono::duration<double>(encoded - start).count();
+			measurement.decodeSeconds = std::chrono::duration<double>(decoded - encoded).count();
+			return measurement;
+		}
+		
+	private:
+		
+		//Scores a measurement for the specified target (lower is better) by modelling the output as being written to and read from
+		//storage with a throughput that represents how much the target values size relative to compression and decompression time
+		static inline double cost(const Measurement& measurement, CompressionTarget target)
+		{
+			double bytesPerSecond = (target == CompressionTarget::Size) ? 1e6 : ((target == CompressionTarget::Speed) ? 1e9 : 1e8);
+			return measurement.encodeSeconds + measurement.decodeSeconds + (2.0 * measurement.compressedBytes / bytesPerSecond);
+		}
+		
+		//Reads tiles spread evenly across the raster bands into a band-sequential buffer, returning the number of tiles read per band
+		static inline unsigned int readSamples(const std::vector<GDALRasterBand*>& bands, GDALDataType dtype, unsigned int blockSize, unsigned int numSamples, std::vector<uint8_t>& samples)
+		{
+			TileGrid grid(bands[0]->GetXSize(), bands[0]->GetYSize(), blockSize, blockSize);
+			unsigned int sampleCount = (unsigned int)(std::max<uint64_t>(1, std::min<uint64_t>(numSamples, grid.numTiles())));
+			uint64_t tileBytes = (uint64_t)(blockSize) * blockSize * GDALGetDataTypeSizeBytes(dtype);
+			samples.assign(tileBytes * sampleCount * bands.size(), 0);
+			
+			//Tiles are read at their full size, so partial tiles at the edges are padded with zeroes
+			for (size_t band = 0; band < bands.size(); ++band)
+			{
+				for (unsigned int sample = 0; sample < sampleCount; ++sample)
+				{
+					RasterWindow tile = grid.window((grid.numTiles() * sample) / sampleCount);
+					int width = std::min(tile.width, bands[band]->GetXSize() - tile.x);
+					int height = std::min(tile.height, bands[band]->GetYSize() - tile.y);
+					uint8_t* buffer = samples.data() + ((band * sampleCount) + sample) * tileBytes;
+					if (width > 0 && height > 0) {
+						bands[band]->RasterIO(GF_Read, tile.x, tile.y, width, height, buffer, width, height, dtype, 0, blockSize * GDALGetDataTypeSizeBytes(dtype), nullptr);
+					}
+				}
+			}
+			
+			return sampleCount;
+		}
+};
+
+} //End namespace mergetiff
+
+#endif
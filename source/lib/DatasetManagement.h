@@ -1,19 +1,29 @@
 #ifndef _MERGETIFF_DATASET_MANAGEMENT
 #define _MERGETIFF_DATASET_MANAGEMENT
 
+#include "CompressionTuning.h"
+#include "DatasetMetadata.h"
 #include "DatatypeConversion.h"
 #include "DriverOptions.h"
 #include "ErrorHandling.h"
 #include "LibrarySettings.h"
+#include "MemoryBudget.h"
+#include "MergeOptions.h"
+#include "MergeStats.h"
+#include "OutputLayout.h"
 #include "RasterData.h"
 #include "RasterIO.h"
+#include "RasterView.h"
 #include "SmartPointers.h"
+#include "TiledMerge.h"
 
 #include <algorithm>
 #include <gdal.h>
 #include <gdal_priv.h>
 #include <cpl_conv.h>
+#include <cpl_vsi.h>
 #include <vrtdataset.h>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -84,12 +94,23 @@ class DatasetManagement
 		}
 		
 		//Writes the raster data from a RasterData object to an image file
+		//(The raster data is wrapped as an in-memory dataset without copying it and exported with the GeoTiff driver's CreateCopy() method, which
+		// reads the buffer in chunks of whole output blocks and compresses them in parallel, so no second copy of the raster data is ever allocated.
+		// The file uses the default tiled layout.)
 		template <typename PrimitiveTy>
 		static inline GDALDatasetRef rasterToFile(const std::string& filename, const RasterData<PrimitiveTy>& data)
 		{
 			GDALDataType dtype = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
 			ArgsArray options = DriverOptions::geoTiffOptions(dtype);
-			return DatasetManagement::datasetFromRaster(data, false, "GTiff", filename, options);
+			OutputLayout::resolve(MergeOptions()).addCreationOptions(options);
+			
+			//Wrap the raster data and copy it into the file
+			GDALDatasetRef wrapped = DatasetManagement::wrapRasterData(data);
+			if (!wrapped) {
+				return GDALDatasetRef();
+			}
+			
+			return DatasetManagement::createDatasetCopy(wrapped, "GTiff", filename, options);
 		}
 		
 		//Reads all of the raster data from a dataset into a RasterData object
@@ -101,6 +122,7 @@ class DatasetManagement
 		}
 		
 		//Creates a GDAL dataset from the supplied raster data (defaults to an in-memory dataset containing a copy of the raster data)
+		//(To access the raster data through GDAL without copying it, use wrapRasterData() or wrapRasterDataForUpdate() instead)
 		template <typename PrimitiveTy>
 		static inline GDALDatasetRef datasetFromRaster(const RasterData<PrimitiveTy>& data, bool forceGrayInterp = false, const std::string& driver = "MEM", const std::string& filename = "", ArgsArray options = ArgsArray())
 		{
@@ -136,18 +158,33 @@ class DatasetManagement
 			}
 			
 			//Set the colour interpretation for each of the raster bands
-			for (int index = 1; index < data.channels(); ++index)
+			for (uint64_t index = 1; index < data.channels(); ++index)
 			{
-				GDALRasterBand* band = dataset->GetRasterBand(index+1);
-				DatasetManagement::setColourInterpretation(band, index, data.channels(), forceGrayInterp);
+				GDALRasterBand* band = dataset->GetRasterBand((int)(index+1));
+				DatasetManagement::setColourInterpretation(band, (int)(index), (int)(data.channels()), forceGrayInterp);
 			}
 			
 			return dataset;
 		}
 		
-		//Creates a GDAL in-memory dataset that wraps the supplied raster data without copying it
+		//Creates a GDAL in-memory dataset that wraps the supplied raster data without copying it, respecting the layout of its channels
+		template <typename PrimitiveTy>
+		static inline GDALDatasetRef wrapRasterData(const RasterData<PrimitiveTy>& data, bool forceGrayInterp = false) {
+			return DatasetManagement::wrapRasterData<PrimitiveTy>(RasterView<PrimitiveTy>(const_cast< RasterData<PrimitiveTy>& >(data)), forceGrayInterp);
+		}
+		
+		//Creates a GDAL in-memory dataset that wraps the supplied raster data without copying it and can be written to, so that GDAL operations
+		//which write to a dataset (such as RasterIO() writes, warping or rasterisation) modify the raster data directly
+		template <typename PrimitiveTy>
+		static inline GDALDatasetRef wrapRasterDataForUpdate(RasterData<PrimitiveTy>& data, bool forceGrayInterp = false) {
+			return DatasetManagement::wrapRasterData<PrimitiveTy>(RasterView<PrimitiveTy>(data), forceGrayInterp, true);
+		}
+		
+		//Creates a GDAL in-memory dataset that wraps a view of raster data without copying it, such as a region of interest or a subset of the channels of a larger buffer
+		//(The view's spacing is encoded in the PIXELOFFSET, LINEOFFSET and BANDOFFSET options of the MEM driver, and the buffer must outlive the dataset.
+		// If writable is true then the dataset is opened in update mode, and writes to the dataset modify the viewed buffer directly.)
 		template <typename PrimitiveTy>
-		static inline GDALDatasetRef wrapRasterData(const RasterData<PrimitiveTy>& data, bool forceGrayInterp = false)
+		static inline GDALDatasetRef wrapRasterData(const RasterView<PrimitiveTy>& view, bool forceGrayInterp = false, bool writable = false)
 		{
 			//Register all GDAL drivers
 			GDALAllRegister();
@@ -156,20 +193,20 @@ class DatasetManagement
 			GDALDataType dtype = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
 			std::string dtypeName = GDALGetDataTypeName(dtype);
 			char ptrStrBuf[256];
-			int ptrStrLen = CPLPrintPointer(ptrStrBuf, (void*)(data.getBuffer()), 256);
+			int ptrStrLen = CPLPrintPointer(ptrStrBuf, (void*)(view.getBuffer()), 256);
 			std::string ptrStr = std::string(ptrStrBuf, ptrStrLen);
 			std::string filename = std::string("MEM:::") +
 				"DATAPOINTER=" + ptrStr +
-				",PIXELS=" + std::to_string(data.cols()) +
-				",LINES=" + std::to_string(data.rows()) +
-				",BANDS=" + std::to_string(data.channels()) +
+				",PIXELS=" + std::to_string(view.cols()) +
+				",LINES=" + std::to_string(view.rows()) +
+				",BANDS=" + std::to_string(view.channels()) +
 				",DATATYPE=" + dtypeName +
-				",PIXELOFFSET=" + std::to_string(data.channels() * sizeof(PrimitiveTy)) +
-				",LINEOFFSET=" + std::to_string(data.cols() * data.channels() * sizeof(PrimitiveTy)) +
-				",BANDOFFSET=" + std::to_string(sizeof(PrimitiveTy));
+				",PIXELOFFSET=" + std::to_string(view.pixelSpacing() * sizeof(PrimitiveTy)) +
+				",LINEOFFSET=" + std::to_string(view.lineSpacing() * sizeof(PrimitiveTy)) +
+				",BANDOFFSET=" + std::to_string(view.channelSpacing() * sizeof(PrimitiveTy));
 			
 			//Attempt to open the dataset
-			GDALDataset* dataset = (GDALDataset*)(GDALOpen(filename.c_str(), GA_ReadOnly));
+			GDALDataset* dataset = (GDALDataset*)(GDALOpen(filename.c_str(), writable ? GA_Update : GA_ReadOnly));
 			
 			//Verify that we were able to open the dataset
 			if (dataset == nullptr) {
@@ -177,17 +214,17 @@ class DatasetManagement
 			}
 			
 			//Set the colour interpretation for each of the raster bands
-			for (int index = 1; index < data.channels(); ++index)
+			for (uint64_t index = 1; index < view.channels(); ++index)
 			{
-				GDALRasterBand* band = dataset->GetRasterBand(index+1);
-				DatasetManagement::setColourInterpretation(band, index, data.channels(), forceGrayInterp);
+				GDALRasterBand* band = dataset->GetRasterBand((int)(index+1));
+				DatasetManagement::setColourInterpretation(band, (int)(index), (int)(view.channels()), forceGrayInterp);
 			}
 			
 			return GDALDatasetRef(dataset);
 		}
 		
-		//Creates a copy of the supplied dataset using the CreateCopy() method of the specified driver
-		static inline GDALDatasetRef createDatasetCopy(GDALDatasetRef& dataset, const std::string& driver, const std::string& filename)
+		//Creates a copy of the supplied dataset using the CreateCopy() method of the specified driver, with optional creation options
+		static inline GDALDatasetRef createDatasetCopy(GDALDatasetRef& dataset, const std::string& driver, const std::string& filename, ArgsArray options = ArgsArray())
 		{
 			//Register all GDAL drivers
 			GDALAllRegister();
@@ -203,7 +240,7 @@ class DatasetManagement
 				filename.c_str(),
 				MERGETIFF_SMART_POINTER_GET(dataset),
 				false,
-				nullptr,
+				options.get(),
 				nullptr,
 				nullptr
 			);
@@ -217,12 +254,23 @@ class DatasetManagement
 		}
 		
 		//Creates a merged dataset containing all of the supplied raster bands along with the metadata from the specified dataset
+		//(If a statistics object is supplied then it is populated with performance statistics for the merge)
 		template <typename PrimitiveTy>
-		static inline GDALDatasetRef createMergedDatasetForType(const std::string& filename, GDALDatasetRef& metadataDataset, std::vector<GDALRasterBand*> rasterBands, GDALProgressFunc progressCallback = nullptr)
+		static inline GDALDatasetRef createMergedDatasetForType(const std::string& filename, GDALDatasetRef& metadataDataset, std::vector<GDALRasterBand*> rasterBands, GDALProgressFunc progressCallback = nullptr, const MergeOptions& mergeOptions = MergeOptions(), MergeStats* stats = nullptr)
 		{
 			//Register all GDAL drivers
 			GDALAllRegister();
 			
+			//Verify that at least one raster band was supplied
+			if (rasterBands.empty()) {
+				return ErrorHandling::handleError<GDALDatasetRef>("no raster bands were supplied for merging");
+			}
+			
+			//Use the tiled merge engine unless the VRT engine has been requested (the tiled engine converts bands with differing datatypes)
+			if (mergeOptions.engine == MergeEngine::Tiled) {
+				return TiledMerge::mergeBands<PrimitiveTy>(filename, metadataDataset, rasterBands, progressCallback, mergeOptions, stats);
+			}
+			
 			//Verify that all of the supplied raster bands have the correct datatype
 			GDALDataType expectedType = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
 			for (auto band : rasterBands)
@@ -232,6 +280,40 @@ class DatasetManagement
 				}
 			}
 			
+			//Verify that Cloud Optimized GeoTiff output was not requested, since this is only supported by the tiled engine
+			if (mergeOptions.format == OutputFormat::COG) {
+				return ErrorHandling::handleError<GDALDatasetRef>("Cloud Optimized GeoTiff output requires the tiled merge engine");
+			}
+			
+			//Verify that no grid alignment was requested, since this is only supported by the tiled engine
+			if (mergeOptions.alignment != GridAlignment::None) {
+				return ErrorHandling::handleError<GDALDatasetRef>("grid alignment requires the tiled merge engine");
+			}
+			
+			//Verify that no computed bands were requested, since these are only supported by the tiled engine
+			if (mergeOptions.bandExpressions.empty() == false) {
+				return ErrorHandling::handleError<GDALDatasetRef>("computed bands require the tiled merge engine");
+			}
+			
+			//Verify that band statistics were not requested, since the VRT engine never holds the tiles in memory to compute them from
+			if (mergeOptions.computeStatistics == true) {
+				return ErrorHandling::handleError<GDALDatasetRef>("computing band statistics requires the tiled merge engine");
+			}
+			
+			//Verify that no value transformations were requested, since these are only supported by the tiled engine
+			for (auto& transform : mergeOptions.bandTransforms)
+			{
+				if (transform.isIdentity() == false) {
+					return ErrorHandling::handleError<GDALDatasetRef>("band value transformations require the tiled merge engine");
+				}
+			}
+			
+			//Resolve the output layout and verify that the block size is valid for it (tiled GeoTiffs require multiples of 16)
+			OutputLayout layout = OutputLayout::resolve(mergeOptions);
+			if (layout.tiled && layout.blockSize % 16 != 0) {
+				return ErrorHandling::handleError<GDALDatasetRef>("output tile size must be a multiple of 16");
+			}
+			
 			//Attempt to retrieve a reference to the GeoTiff VRT driver
 			GDALDriver* vrtDriver = ((GDALDriver*)GDALGetDriverByName("VRT"));
 			if (vrtDriver == nullptr) {
@@ -245,6 +327,8 @@ class DatasetManagement
 			}
 			
 			//Attempt to create a virtual dataset
+			Stopwatch totalTime;
+			Stopwatch phaseTime;
 			int width  = rasterBands[0]->GetXSize();
 			int height = rasterBands[0]->GetYSize();
 			GDALDataset* virtualDataset = vrtDriver->Create("", width, height, 0, expectedType, nullptr);
@@ -258,49 +342,8 @@ class DatasetManagement
 			GDALDatasetRef virtualWrapper(virtualDataset);
 			
 			//If a dataset was specified to copy metadata from, do so
-			if (metadataDataset)
-			{
-				//Extract the list of metadata domains
-				char** domains = metadataDataset->GetMetadataDomainList();
-				
-				//Check if there are any metadata domains
-				if (domains == nullptr)
-				{
-					//No domains, simply copy the metadata for the default domain
-					virtualDataset->SetMetadata(metadataDataset->GetMetadata());
-				}
-				else
-				{
-					//Copy the metadata for each domain
-					char** currDomain = domains;
-					while (*currDomain != nullptr)
-					{
-						virtualDataset->SetMetadata(metadataDataset->GetMetadata(*currDomain), *currDomain);
-						currDomain++;
-					}
-					
-					//Free the domain list
-					CSLDestroy(domains);
-				}
-				
-				//Copy projection
-				virtualDataset->SetProjection(metadataDataset->GetProjectionRef());
-				
-				//Copy affine GeoTransform
-				double padfTransform[6];
-				if (metadataDataset->GetGeoTransform(padfTransform) != CE_Failure) {
-					virtualDataset->SetGeoTransform(padfTransform);
-				}
-				
-				//Copy GCPs
-				if (metadataDataset->GetGCPCount() > 0)
-				{
-					virtualDataset->SetGCPs(
-						metadataDataset->GetGCPCount(),
-						metadataDataset->GetGCPs(),
-						metadataDataset->GetGCPProjection()
-					);
-				}
+			if (metadataDataset) {
+				DatasetMetadata::copyDatasetMetadata(MERGETIFF_SMART_POINTER_GET(metadataDataset), virtualDataset);
 			}
 			
 			//Assign each of the input raster bands as the source for the corresponding virtual band
@@ -316,22 +359,22 @@ class DatasetManagement
 				//Add the input band as the source for the output band
 				outputBand->AddSimpleSource(inputBand, 0, 0, width, height, 0, 0, width, height);
 				
-				//Copy the "no data" sentinel value, if any
-				int hasNoDataValue = 0;
-				double noDataValue = inputBand->GetNoDataValue(&hasNoDataValue);
-				if (hasNoDataValue) {
-					outputBand->SetNoDataValue(noDataValue);
-				}
-				
-				//Copy the colour interpretation value, if any
-				GDALColorInterp colourInterp = inputBand->GetColorInterpretation();
-				if (colourInterp != GCI_Undefined) {
-					outputBand->SetColorInterpretation(colourInterp);
-				}
+				//Copy the "no data" sentinel value and colour interpretation, if any
+				DatasetMetadata::copyBandMetadata(inputBand, outputBand);
 			}
 			
-			//Attempt to create the output dataset as a copy of the virtual dataset
-			ArgsArray options = DriverOptions::geoTiffOptions(expectedType);
+			double metadataSeconds = phaseTime.restart();
+			
+			//If a memory budget was specified, use it to size the GDAL block cache (which determines the size of the chunks that CreateCopy() processes)
+			MemoryBudget budget(mergeOptions.memoryBudget);
+			uint64_t blockBytes = (uint64_t)(layout.blockWidth(width)) * layout.blockHeight() * rasterBands.size() * sizeof(PrimitiveTy);
+			std::unique_ptr<ScopedCacheLimit> cacheLimit(budget.limited() ? new ScopedCacheLimit(budget.cacheBytes(blockBytes)) : nullptr);
+			
+			//Attempt to create the output dataset as a copy of the virtual dataset, selecting a codec from a sample of the input tiles if requested
+			//(For sparse output, GDAL omits the blocks that contain nothing but "no data" as it copies them)
+			CompressionProfile compression = CompressionTuning::resolve(mergeOptions.compression, rasterBands, expectedType, layout.blockSize);
+			ArgsArray options = DriverOptions::geoTiffOptions(expectedType, compression, mergeOptions.sparseOutput);
+			layout.addCreationOptions(options);
 			GDALDataset* dataset = tiffDriver->CreateCopy(
 				filename.c_str(),
 				virtualDataset,
@@ -346,15 +389,54 @@ class DatasetManagement
 				return ErrorHandling::handleError<GDALDatasetRef>("failed to open output dataset \"" + filename + "\"");
 			}
 			
+			//CreateCopy() reads, encodes and writes each chunk in turn, so its time is reported as encoding time and every input band is read in full
+			if (stats != nullptr)
+			{
+				stats->metadataSeconds += metadataSeconds;
+				stats->encodeSeconds += phaseTime.elapsed();
+				for (auto band : rasterBands)
+				{
+					GDALDataset* source = band->GetDataset();
+					stats->input((source != nullptr) ? source->GetDescription() : "").bytesRead += (uint64_t)(width) * height * sizeof(PrimitiveTy);
+				}
+				
+				VSIStatBufL outputStats;
+				if (VSIStatL(filename.c_str(), &outputStats) == 0) {
+					stats->bytesWritten = outputStats.st_size;
+				}
+				
+				stats->peakMemoryBytes = MemoryUsage::peakResidentBytes();
+				stats->totalSeconds = stats->openSeconds + totalTime.elapsed();
+			}
+			
 			return GDALDatasetRef(dataset);
 		}
 		
 		//Helper function for createMergedDatasetForType() to automatically provide the correct template argument
-		static inline GDALDatasetRef createMergedDataset(const std::string& filename, GDALDatasetRef& metadataDataset, std::vector<GDALRasterBand*> rasterBands, GDALProgressFunc progressCallback = nullptr)
+		static inline GDALDatasetRef createMergedDataset(const std::string& filename, GDALDatasetRef& metadataDataset, std::vector<GDALRasterBand*> rasterBands, GDALProgressFunc progressCallback = nullptr, const MergeOptions& mergeOptions = MergeOptions(), MergeStats* stats = nullptr)
 		{
-			GDALDataType dtype = rasterBands[0]->GetRasterDataType();
+			//Verify that at least one raster band was supplied
+			if (rasterBands.empty()) {
+				return ErrorHandling::handleError<GDALDatasetRef>("no raster bands were supplied for merging");
+			}
+			
+			//Use the requested output datatype, or promote the datatypes of the input bands to a common type
+			//(Computed bands usually produce fractional values, so they promote the output to at least Float32)
+			GDALDataType dtype = mergeOptions.outputType;
+			if (dtype == GDT_Unknown)
+			{
+				std::vector<GDALDataType> bandTypes;
+				for (auto band : rasterBands) {
+					bandTypes.push_back(band->GetRasterDataType());
+				}
+				if (mergeOptions.bandExpressions.empty() == false) {
+					bandTypes.push_back(GDT_Float32);
+				}
+				
+				dtype = DatatypeConversion::promoteTypes(bandTypes);
+			}
 			
-			#define _CREATE_MERGED(GdalTy, PrimitiveTy) case GdalTy: return DatasetManagement::createMergedDatasetForType<PrimitiveTy>(filename, metadataDataset, rasterBands, progressCallback)
+			#define _CREATE_MERGED(GdalTy, PrimitiveTy) case GdalTy: return DatasetManagement::createMergedDatasetForType<PrimitiveTy>(filename, metadataDataset, rasterBands, progressCallback, mergeOptions, stats)
 			switch (dtype)
 			{
 				_CREATE_MERGED(GDT_Byte,    uint8_t);
@@ -0,0 +1,81 @@
+#ifndef _MERGETIFF_DATASET_METADATA
+#define _MERGETIFF_DATASET_METADATA
+
+#include <cpl_conv.h>
+#include <cpl_string.h>
+#include <gdal.h>
+#include <gdal_priv.h>
+
+namespace mergetiff {
+
+class DatasetMetadata
+{
+	public:
+		
+		//Copies the metadata, projection, geotransform and GCPs from one dataset to another
+		static inline void copyDatasetMetadata(GDALDataset* source, GDALDataset* dest)
+		{
+			//Extract the list of metadata domains
+			char** domains = source->GetMetadataDomainList();
+			
+			//Check if there are any metadata domains
+			if (domains == nullptr)
+			{
+				//No domains, simply copy the metadata for the default domain
+				dest->SetMetadata(source->GetMetadata());
+			}
+			else
+			{
+				//Copy the metadata for each domain
+				char** currDomain = domains;
+				while (*currDomain != nullptr)
+				{
+					dest->SetMetadata(source->GetMetadata(*currDomain), *currDomain);
+					currDomain++;
+				}
+				
+				//Free the domain list
+				CSLDestroy(domains);
+			}
+			
+			//Copy projection
+			dest->SetProjection(source->GetProjectionRef());
+			
+			//Copy affine GeoTransform
+			double padfTransform[6];
+			if (source->GetGeoTransform(padfTransform) != CE_Failure) {
+				dest->SetGeoTransform(padfTransform);
+			}
+			
+			//Copy GCPs
+			if (source->GetGCPCount() > 0)
+			{
+				dest->SetGCPs(
+					source->GetGCPCount(),
+					source->GetGCPs(),
+					source->GetGCPProjection()
+				);
+			}
+		}
+		
+		//Copies the "no data" sentinel value and colour interpretation from one raster band to another
+		static inline void copyBandMetadata(GDALRasterBand* source, GDALRasterBand* dest)
+		{
+			//Copy the "no data" sentinel value, if any
+			int hasNoDataValue = 0;
+			double noDataValue = source->GetNoDataValue(&hasNoDataValue);
+			if (hasNoDataValue) {
+				dest->SetNoDataValue(noDataValue);
+			}
+			
+			//Copy the colour interpretation value, if any
+			GDALColorInterp colourInterp = source->GetColorInterpretation();
+			if (colourInterp != GCI_Undefined) {
+				dest->SetColorInterpretation(colourInterp);
+			}
+		}
+};
+
+} //End namespace mergetiff
+
+#endif
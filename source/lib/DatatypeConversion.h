@@ -5,6 +5,10 @@
 
 #include <gdal.h>
 #include <stdint.h>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <vector>
 
 namespace mergetiff {
 namespace DatatypeConversion {
@@ -23,6 +27,179 @@ _MERGETIFF_P2G_SPECIALISATION(int32_t,  GDT_Int32)
 _MERGETIFF_P2G_SPECIALISATION(float,    GDT_Float32)
 _MERGETIFF_P2G_SPECIALISATION(double,   GDT_Float64)
 
+//Determines if a GDAL datatype has a corresponding primitive type specialisation above
+inline bool isSupported(GDALDataType dtype)
+{
+	switch (dtype)
+	{
+		case GDT_Byte:
+		case GDT_UInt16:
+		case GDT_Int16:
+		case GDT_UInt32:
+		case GDT_Int32:
+		case GDT_Float32:
+		case GDT_Float64:
+			return true;
+		
+		default:
+			return false;
+	}
+}
+
+//Determines the smallest GDAL datatype that can represent the values of all of the supplied datatypes
+inline GDALDataType promoteTypes(const std::vector<GDALDataType>& types)
+{
+	GDALDataType result = GDT_Unknown;
+	for (auto dtype : types) {
+		result = (result == GDT_Unknown) ? dtype : GDALDataTypeUnion(result, dtype);
+	}
+	
+	return result;
+}
+
+//Describes a linear transformation that is applied to pixel values when converting between datatypes
+class ValueTransform
+{
+	public:
+		
+		ValueTransform() : scale(1.0), offset(0.0), clamp(false), clampMin(0.0), clampMax(0.0) {}
+		ValueTransform(double scale, double offset) : scale(scale), offset(offset), clamp(false), clampMin(0.0), clampMax(0.0) {}
+		
+		//Determines if the transformation leaves values unchanged (aside from the conversion itself)
+		bool isIdentity() const {
+			return this->scale == 1.0 && this->offset == 0.0 && this->clamp == false;
+		}
+		
+		//Output values are computed as (input * scale) + offset
+		double scale;
+		double offset;
+		
+		//If clamping is enabled, output values are clamped to [clampMin, clampMax] in addition to the range of the output type
+		bool clamp;
+		double clampMin;
+		double clampMax;
+};
+
+//The type used for intermediate computations when converting between two primitive types
+//(single-precision arithmetic is used whenever it represents both types exactly, since it vectorises twice as wide)
+template <typename InputTy, typename OutputTy>
+struct ComputeType
+{
+	typedef typename std::conditional<
+		(std::is_integral<InputTy>::value && sizeof(InputTy) >= 4) ||
+		(std::is_integral<OutputTy>::value && sizeof(OutputTy) >= 4) ||
+		std::is_same<InputTy, double>::value ||
+		std::is_same<OutputTy, double>::value,
+		double,
+		float
+	>::type type;
+};
+
+//Clamps a value for an integer output type, mapping NaN to the lower bound
+template <typename ComputeTy>
+inline ComputeTy clampValue(ComputeTy value, ComputeTy low, ComputeTy high, std::true_type)
+{
+	value = (value > low) ? value : low;
+	return (value < high) ? value : high;
+}
+
+//Clamps a value for a floating-point output type, propagating NaN
+template <typename ComputeTy>
+inline ComputeTy clampValue(ComputeTy value, ComputeTy low, ComputeTy high, std::false_type)
+{
+	value = (value < low) ? low : value;
+	return (value > high) ? high : value;
+}
+
+//Rounds a value to the nearest integer for integer output types
+template <typename OutputTy, typename ComputeTy>
+inline OutputTy roundValue(ComputeTy value, std::true_type) {
+	return (OutputTy)(value + ((value < 0) ? ComputeTy(-0.5) : ComputeTy(0.5)));
+}
+
+//Floating-point output types require no rounding
+template <typename OutputTy, typename ComputeTy>
+inline OutputTy roundValue(ComputeTy value, std::false_type) {
+	return (OutputTy)(value);
+}
+
+//Converts a single value to the output type, saturating values that fall outside the range of the type
+template <typename OutputTy>
+inline OutputTy saturate(double value)
+{
+	typedef typename std::is_integral<OutputTy>::type IsIntegral;
+	double low = (double)(std::numeric_limits<OutputTy>::lowest());
+	double high = (double)(std::numeric_limits<OutputTy>::max());
+	return roundValue<OutputTy>(clampValue(value, low, high, IsIntegral()), IsIntegral());
+}
+
+//Converts a buffer of values to the output type, applying the supplied transformation
+//(the loops are branch-free so that the compiler can vectorise them for each combination of types)
+template <typename InputTy, typename OutputTy>
+inline void transformValues(const InputTy* input, OutputTy* output, uint64_t count, const ValueTransform& transform, bool hasNoData = false, double noDataValue = 0.0)
+{
+	typedef typename ComputeType<InputTy, OutputTy>::type ComputeTy;
+	typedef typename std::is_integral<OutputTy>::type IsIntegral;
+	
+	//Determine the range of valid output values
+	double low = (double)(std::numeric_limits<OutputTy>::lowest());
+	double high = (double)(std::numeric_limits<OutputTy>::max());
+	if (transform.clamp == true)
+	{
+		low = std::max(low, transform.clampMin);
+		high = std::min(high, transform.clampMax);
+	}
+	
+	const ComputeTy scale = (ComputeTy)(transform.scale);
+	const ComputeTy offset = (ComputeTy)(transform.offset);
+	const ComputeTy lowValue = (ComputeTy)(low);
+	const ComputeTy highValue = (ComputeTy)(high);
+	for (uint64_t index = 0; index < count; ++index)
+	{
+		ComputeTy value = ((ComputeTy)(input[index]) * scale) + offset;
+		output[index] = roundValue<OutputTy>(clampValue(value, lowValue, highValue, IsIntegral()), IsIntegral());
+	}
+	
+	//Pixels containing the "no data" sentinel value are passed through rather than transformed
+	if (hasNoData == true)
+	{
+		const OutputTy outputNoData = saturate<OutputTy>(noDataValue);
+		if (noDataValue != noDataValue)
+		{
+			for (uint64_t index = 0; index < count; ++index) {
+				output[index] = (input[index] != input[index]) ? outputNoData : output[index];
+			}
+		}
+		else
+		{
+			for (uint64_t index = 0; index < count; ++index) {
+				output[index] = ((double)(input[index]) == noDataValue) ? outputNoData : output[index];
+			}
+		}
+	}
+}
+
+//Converts a buffer of values with the specified GDAL datatype to the output type, applying the supplied transformation
+template <typename OutputTy>
+inline bool transformValues(GDALDataType inputType, const void* input, OutputTy* output, uint64_t count, const ValueTransform& transform, bool hasNoData = false, double noDataValue = 0.0)
+{
+	#define _MERGETIFF_TRANSFORM(GdalTy, PrimitiveTy) case GdalTy: transformValues<PrimitiveTy, OutputTy>((const PrimitiveTy*)(input), output, count, transform, hasNoData, noDataValue); return true
+	switch (inputType)
+	{
+		_MERGETIFF_TRANSFORM(GDT_Byte,    uint8_t);
+		_MERGETIFF_TRANSFORM(GDT_Int16,   int16_t);
+		_MERGETIFF_TRANSFORM(GDT_UInt16,  uint16_t);
+		_MERGETIFF_TRANSFORM(GDT_Int32,   int32_t);
+		_MERGETIFF_TRANSFORM(GDT_UInt32,  uint32_t);
+		_MERGETIFF_TRANSFORM(GDT_Float32, float);
+		_MERGETIFF_TRANSFORM(GDT_Float64, double);
+		
+		default:
+			return false;
+	}
+	#undef _MERGETIFF_TRANSFORM
+}
+
 } //End namespace DatatypeConversion
 } //End namespace mergetiff
 
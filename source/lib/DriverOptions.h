@@ -2,29 +2,159 @@
 #define _MERGETIFF_DRIVER_OPTIONS
 
 #include "ArgsArray.h"
+#include <cpl_string.h>
 #include <gdal.h>
+#include <gdal_version.h>
+#include <string>
 
 namespace mergetiff {
 
+//The compression codecs available for GeoTiff output
+enum class CompressionCodec
+{
+	//LZW compression with a predictor (the GDAL default for our outputs)
+	LZW,
+	
+	//DEFLATE compression with a predictor and an optional compression level
+	Deflate,
+	
+	//Zstandard compression with a predictor and an optional compression level (requires GDAL to be built with ZSTD support)
+	ZSTD,
+	
+	//LERC compression with an optional maximum error per pixel (lossless when the maximum error is zero)
+	LERC,
+	
+	//No compression, which is the fastest choice for short-lived scratch files
+	None,
+	
+	//Selects one of the lossless codecs by compressing a sample of tiles with each candidate (see CompressionTuning)
+	Auto
+};
+
+//What the automatic codec selection optimises for
+enum class CompressionTarget
+{
+	//Prefers the smallest output, regardless of the time spent compressing and decompressing it
+	Size,
+	
+	//Balances compression and decompression time against the size of the output
+	Balanced,
+	
+	//Prefers the fastest compression and decompression, even if the output is larger
+	Speed
+};
+
+//Describes the compression settings used when creating GeoTiff datasets
+class CompressionProfile
+{
+	public:
+		
+		CompressionProfile(CompressionCodec codec = CompressionCodec::LZW, int level = 0, double maxError = 0.0) :
+			codec(codec),
+			level(level),
+			maxError(maxError),
+			target(CompressionTarget::Balanced)
+		{}
+		
+		//Returns the value of the GDAL COMPRESS creation option for the codec
+		std::string name() const
+		{
+			switch (this->codec)
+			{
+				case CompressionCodec::Deflate: return "DEFLATE";
+				case CompressionCodec::ZSTD:    return "ZSTD";
+				case CompressionCodec::LERC:    return "LERC";
+				case CompressionCodec::None:    return "NONE";
+				default:                        return "LZW";
+			}
+		}
+		
+		//Determines if the codec uses a predictor
+		bool usesPredictor() const {
+			return this->codec == CompressionCodec::LZW || this->codec == CompressionCodec::Deflate || this->codec == CompressionCodec::ZSTD;
+		}
+		
+		//The codec to use
+		CompressionCodec codec;
+		
+		//The compression level for DEFLATE (1-9) or ZSTD (1-22), with zero selecting the GDAL default
+		int level;
+		
+		//The maximum error per pixel for LERC, with zero selecting lossless compression
+		double maxError;
+		
+		//What the selection optimises for when the codec is CompressionCodec::Auto
+		CompressionTarget target;
+};
+
 class DriverOptions
 {
 	public:
 		
 		//Returns the driver options for creating datasets with the GeoTiff driver
-		static inline ArgsArray geoTiffOptions(GDALDataType dtype)
+		//(The Auto codec must be resolved using CompressionTuning beforehand, and is treated as LZW here. Sparse datasets omit the blocks that are never
+		// written, which GDAL reads as the band's "no data" value, or zero if it has none.)
+		static inline ArgsArray geoTiffOptions(GDALDataType dtype, const CompressionProfile& compression = CompressionProfile(), bool sparse = false)
 		{
-			//Use LZW compresion/decompression with all CPU cores
+			//Use the requested compression/decompression with all CPU cores
 			ArgsArray options;
 			options.add("NUM_THREADS=ALL_CPUS");
-			options.add("COMPRESS=LZW");
+			options.add("COMPRESS=" + compression.name());
+			if (sparse == true) {
+				options.add("SPARSE_OK=TRUE");
+			}
 			
 			//Use predictor=2 for integer types and predictor=3 for floating-point types
-			if (dtype == GDT_Float32 || dtype == GDT_Float64) {
-				options.add("PREDICTOR=3");
+			if (compression.usesPredictor())
+			{
+				if (dtype == GDT_Float32 || dtype == GDT_Float64) {
+					options.add("PREDICTOR=3");
+				}
+				else {
+					options.add("PREDICTOR=2");
+				}
+			}
+			
+			//Apply the compression level or maximum error, if one was specified
+			if (compression.codec == CompressionCodec::Deflate && compression.level > 0) {
+				options.add("ZLEVEL=" + std::to_string(compression.level));
 			}
-			else {
-				options.add("PREDICTOR=2");
+			else if (compression.codec == CompressionCodec::ZSTD && compression.level > 0) {
+				options.add("ZSTD_LEVEL=" + std::to_string(compression.level));
+			}
+			else if (compression.codec == CompressionCodec::LERC) {
+				options.add(std::string("MAX_Z_ERROR=") + CPLSPrintf("%.17g", compression.maxError));
+			}
+			
+			return options;
+		}
+		
+		//Returns the driver options for creating Cloud Optimized GeoTiffs with the COG driver, using existing overviews
+		static inline ArgsArray cloudOptimisedOptions(GDALDataType dtype, unsigned int blockSize, const CompressionProfile& compression = CompressionProfile(), bool sparse = false)
+		{
+			//Use the same compression as regular GeoTiffs (the COG driver uses named predictor values and a unified level option)
+			ArgsArray options;
+			options.add("NUM_THREADS=ALL_CPUS");
+			options.add("COMPRESS=" + compression.name());
+			if (compression.usesPredictor()) {
+				options.add((dtype == GDT_Float32 || dtype == GDT_Float64) ? "PREDICTOR=FLOATING_POINT" : "PREDICTOR=STANDARD");
+			}
+			if ((compression.codec == CompressionCodec::Deflate || compression.codec == CompressionCodec::ZSTD) && compression.level > 0) {
+				options.add("LEVEL=" + std::to_string(compression.level));
+			}
+			else if (compression.codec == CompressionCodec::LERC) {
+				options.add(std::string("MAX_Z_ERROR=") + CPLSPrintf("%.17g", compression.maxError));
+			}
+			
+			options.add("BLOCKSIZE=" + std::to_string(blockSize));
+			options.add("OVERVIEWS=FORCE_USE_EXISTING");
+			
+			//The COG driver can omit empty blocks in GDAL 3.2 or newer
+			#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3,2,0)
+			if (sparse == true) {
+				options.add("SPARSE_OK=TRUE");
 			}
+			#endif
 			
 			return options;
 		}
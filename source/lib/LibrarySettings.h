@@ -24,6 +24,11 @@
 #define MERGETIFF_SMART_POINTER_RESET(ptr, val) ptr.reset(val)
 #endif
 
+//Allow users to override the alignment of the buffers allocated by RasterAllocator objects (the default matches the size of a cache line)
+#ifndef MERGETIFF_BUFFER_ALIGNMENT
+#define MERGETIFF_BUFFER_ALIGNMENT 64
+#endif
+
 //Allow users to specify a logging mechanism for error messages when exception handling is disabled
 #ifndef MERGETIFF_ERROR_LOGGER
 #define MERGETIFF_ERROR_LOGGER(message) fputs(message, stderr)
@@ -0,0 +1,295 @@
+#ifndef _MERGETIFF_MAPPED_RASTER
+#define _MERGETIFF_MAPPED_RASTER
+
+#include "DatatypeConversion.h"
+#include "ErrorHandling.h"
+#include "RasterAllocator.h"
+#include "RasterData.h"
+#include "RasterIO.h"
+#include "SmartPointers.h"
+
+#include <gdal.h>
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace mergetiff {
+
+//Creates and opens RasterData objects whose buffers are memory-mapped files rather than heap memory
+//(The pages of a mapped file are read on demand and can be evicted by the operating system under memory pressure, so rasters larger than physical
+// memory can be processed, and every process that maps the same file shares the same physical pages. Each file starts with a page-sized header that
+// describes the raster in the native byte order, followed by the pixel data. The buffer can be wrapped as a GDAL dataset by wrapRasterData().)
+class MappedRaster
+{
+	public:
+		
+		//The size of the header at the start of each mapped file, which keeps the pixel data page-aligned
+		static const uint64_t HeaderSize = 4096;
+		
+		//Creates a new file of the specified dimensions, overwriting any existing file, and maps it into memory with every element initialised to zero
+		template <typename PrimitiveTy>
+		static inline RasterData<PrimitiveTy> create(const std::string& path, uint64_t channels, uint64_t rows, uint64_t cols, RasterLayout layout = RasterLayout::Interleaved)
+		{
+			//Create and map the file
+			uint64_t bytes = channels * rows * cols * sizeof(PrimitiveTy);
+			uint64_t size = HeaderSize + bytes;
+			uint8_t* mapping = MappedRaster::mapFile(path, size, true, true);
+			if (mapping == nullptr) {
+				return ErrorHandling::handleError< RasterData<PrimitiveTy> >("failed to create memory-mapped raster file \"" + path + "\"");
+			}
+			
+			//Write the header that describes the raster
+			FileHeader header;
+			memset(&header, 0, sizeof(header));
+			memcpy(header.magic, MappedRaster::magic(), sizeof(header.magic));
+			header.version = 1;
+			header.datatype = (uint32_t)(DatatypeConversion::primitiveToGdal<PrimitiveTy>());
+			header.layout = (layout == RasterLayout::Planar) ? 1 : 0;
+			header.channels = channels;
+			header.rows = rows;
+			header.cols = cols;
+			memcpy(mapping, &header, sizeof(header));
+			
+			return RasterData<PrimitiveTy>((PrimitiveTy*)(mapping + HeaderSize), channels, rows, cols, MappedRaster::unmapper(), layout);
+		}
+		
+		//Maps an existing file that was created by create() into memory, verifying that its datatype matches the primitive type
+		//(Changes to the buffer of a writable mapping are written back to the file and are visible to every other process that maps it.
+		// The buffer of a read-only mapping must not be modified, since it is mapped without write access.)
+		template <typename PrimitiveTy>
+		static inline RasterData<PrimitiveTy> open(const std::string& path, bool writable = true)
+		{
+			//Attempt to map the file
+			uint64_t size = 0;
+			uint8_t* mapping = MappedRaster::mapFile(path, size, false, writable);
+			if (mapping == nullptr) {
+				return ErrorHandling::handleError< RasterData<PrimitiveTy> >("failed to map raster file \"" + path + "\"");
+			}
+			
+			//Verify that the file contains a valid header
+			FileHeader header;
+			memset(&header, 0, sizeof(header));
+			if (size >= HeaderSize) {
+				memcpy(&header, mapping, sizeof(header));
+			}
+			if (size < HeaderSize || memcmp(header.magic, MappedRaster::magic(), sizeof(header.magic)) != 0 || header.version != 1)
+			{
+				MappedRaster::unmapFile(mapping, size);
+				return ErrorHandling::handleError< RasterData<PrimitiveTy> >("\"" + path + "\" is not a memory-mapped raster file");
+			}
+			
+			//Verify that the datatype matches the primitive type
+			if (header.datatype != (uint32_t)(DatatypeConversion::primitiveToGdal<PrimitiveTy>()))
+			{
+				MappedRaster::unmapFile(mapping, size);
+				return ErrorHandling::handleError< RasterData<PrimitiveTy> >("memory-mapped raster file datatype does not match expected datatype");
+			}
+			
+			//Verify that the size of the file matches the dimensions of the raster, since the whole file is unmapped when the buffer is freed
+			uint64_t bytes = header.channels * header.rows * header.cols * sizeof(PrimitiveTy);
+			if (size != HeaderSize + bytes)
+			{
+				MappedRaster::unmapFile(mapping, size);
+				return ErrorHandling::handleError< RasterData<PrimitiveTy> >("memory-mapped raster file size does not match its raster dimensions");
+			}
+			
+			RasterLayout layout = (header.layout == 1) ? RasterLayout::Planar : RasterLayout::Interleaved;
+			return RasterData<PrimitiveTy>((PrimitiveTy*)(mapping + HeaderSize), header.channels, header.rows, header.cols, MappedRaster::unmapper(), layout);
+		}
+		
+		//Reads the raster data for an entire dataset into a new memory-mapped file, so that it only needs to be decoded once and can then be paged
+		//on demand or shared with other processes (see RasterIO::readDataset() for details of the threading options)
+		template <typename PrimitiveTy>
+		static inline RasterData<PrimitiveTy> readDataset(const std::string& path, GDALDatasetRef& dataset, std::vector<unsigned int> bands = std::vector<unsigned int>(), RasterLayout layout = RasterLayout::Interleaved, unsigned int numThreads = 1)
+		{
+			//Verify that a valid dataset was supplied
+			if (!dataset || dataset->GetRasterCount() < 1) {
+				return ErrorHandling::handleError< RasterData<PrimitiveTy> >("supplied dataset does not contain any raster bands");
+			}
+			
+			//Fill the band list with the indices of all bands present in the dataset if none were specified
+			if (bands.empty())
+			{
+				for (unsigned int index = 1; index <= (unsigned int)(dataset->GetRasterCount()); ++index) {
+					bands.push_back(index);
+				}
+			}
+			
+			//Create the mapped file and read the raster data into it
+			RasterData<PrimitiveTy> data = MappedRaster::create<PrimitiveTy>(path, bands.size(), dataset->GetRasterYSize(), dataset->GetRasterXSize(), layout);
+			if (!data || RasterIO::readDataset<PrimitiveTy>(dataset, data, bands, 0, numThreads) == false) {
+				return RasterData<PrimitiveTy>();
+			}
+			
+			return data;
+		}
+		
+		//Determines if the buffer of a RasterData object is a memory-mapped file
+		template <typename PrimitiveTy>
+		static inline bool isMapped(const RasterData<PrimitiveTy>& data) {
+			return data.getBuffer() != nullptr && data.allocator() == MappedRaster::unmapper();
+		}
+		
+		//Writes any modified pages of a memory-mapped buffer back to its file, waiting for the writes to complete
+		template <typename PrimitiveTy>
+		static inline bool flush(const RasterData<PrimitiveTy>& data)
+		{
+			if (MappedRaster::isMapped(data) == false) {
+				return ErrorHandling::handleError<bool>("supplied raster data is not memory-mapped");
+			}
+			
+			uint8_t* mapping = (uint8_t*)(data.getBuffer()) - HeaderSize;
+			uint64_t size = HeaderSize + (data.channels() * data.rows() * data.cols() * sizeof(PrimitiveTy));
+			
+			#if defined(_WIN32)
+			return FlushViewOfFile(mapping, (SIZE_T)(size)) != 0;
+			#elif defined(__unix__) || defined(__APPLE__)
+			return msync(mapping, (size_t)(size), MS_SYNC) == 0;
+			#else
+			return false;
+			#endif
+		}
+		
+	private:
+		
+		//The header at the start of each mapped file
+		struct FileHeader
+		{
+			char magic[16];
+			uint32_t version;
+			uint32_t datatype;
+			uint32_t layout;
+			uint32_t reserved;
+			uint64_t channels;
+			uint64_t rows;
+			uint64_t cols;
+		};
+		
+		//Returns the identifier that the header of each mapped file starts with
+		static inline const char* magic() {
+			return "MERGETIFF-RASTER";
+		}
+		
+		//Unmaps the files of memory-mapped buffers when their RasterData objects are destroyed
+		class Unmapper : public RasterAllocator
+		{
+			public:
+				
+				//Mappings are only created by MappedRaster, so this allocator never allocates buffers itself
+				virtual void* allocate(uint64_t) {
+					return nullptr;
+				}
+				
+				virtual void deallocate(void* buffer, uint64_t bytes) {
+					MappedRaster::unmapFile((uint8_t*)(buffer) - HeaderSize, HeaderSize + bytes);
+				}
+		};
+		
+		//Returns the allocator shared by all memory-mapped buffers
+		static inline RasterAllocator* unmapper()
+		{
+			static Unmapper instance;
+			return &instance;
+		}
+		
+		//Maps a file into memory with shared access, returning nullptr on failure
+		//(If create is true then the file is created with the specified size, otherwise the size of the existing file is stored in size)
+		static inline uint8_t* mapFile(const std::string& path, uint64_t& size, bool create, bool writable)
+		{
+			#if defined(_WIN32)
+			
+			//Open or create the file
+			HANDLE file = CreateFileA(
+				path.c_str(),
+				writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+				FILE_SHARE_READ | FILE_SHARE_WRITE,
+				nullptr,
+				create ? CREATE_ALWAYS : OPEN_EXISTING,
+				FILE_ATTRIBUTE_NORMAL,
+				nullptr
+			);
+			
+			if (file == INVALID_HANDLE_VALUE) {
+				return nullptr;
+			}
+			
+			//Resize the file if we created it, or retrieve its size otherwise
+			LARGE_INTEGER fileSize;
+			fileSize.QuadPart = (LONGLONG)(size);
+			bool success = (create == true) ? (SetFilePointerEx(file, fileSize, nullptr, FILE_BEGIN) != 0 && SetEndOfFile(file) != 0) : (GetFileSizeEx(file, &fileSize) != 0);
+			size = (uint64_t)(fileSize.QuadPart);
+			if (success == false || size == 0)
+			{
+				CloseHandle(file);
+				return nullptr;
+			}
+			
+			//Map the whole file (the view remains valid once the file and mapping handles are closed)
+			HANDLE mapping = CreateFileMappingA(file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+			CloseHandle(file);
+			if (mapping == nullptr) {
+				return nullptr;
+			}
+			
+			void* view = MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);
+			return (uint8_t*)(view);
+			
+			#elif defined(__unix__) || defined(__APPLE__)
+			
+			//Open or create the file
+			int flags = (writable ? O_RDWR : O_RDONLY) | (create ? (O_CREAT | O_TRUNC) : 0);
+			int fd = ::open(path.c_str(), flags, 0644);
+			if (fd == -1) {
+				return nullptr;
+			}
+			
+			//Resize the file if we created it, or retrieve its size otherwise
+			struct stat details;
+			bool success = (create == true) ? (ftruncate(fd, (off_t)(size)) == 0) : (fstat(fd, &details) == 0);
+			if (success == true && create == false) {
+				size = (uint64_t)(details.st_size);
+			}
+			if (success == false || size == 0)
+			{
+				close(fd);
+				return nullptr;
+			}
+			
+			//Map the whole file (the mapping remains valid once the file descriptor is closed)
+			void* mapping = mmap(nullptr, (size_t)(size), writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+			close(fd);
+			return (mapping != MAP_FAILED) ? (uint8_t*)(mapping) : nullptr;
+			
+			#else
+			return nullptr;
+			#endif
+		}
+		
+		//Unmaps a file that was mapped by mapFile()
+		static inline void unmapFile(uint8_t* mapping, uint64_t size)
+		{
+			#if defined(_WIN32)
+			UnmapViewOfFile(mapping);
+			#elif defined(__unix__) || defined(__APPLE__)
+			munmap(mapping, (size_t)(size));
+			#endif
+		}
+};
+
+} //End namespace mergetiff
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef _MERGETIFF_MEMORY_BUDGET
+#define _MERGETIFF_MEMORY_BUDGET
+
+#include <gdal.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace mergetiff {
+
+//Provides access to the memory usage of the current process
+class MemoryUsage
+{
+	public:
+		
+		//Returns the current resident set size of the process in bytes, or zero if it cannot be determined on this platform
+		static inline uint64_t currentResidentBytes()
+		{
+			#if defined(__linux__)
+			unsigned long long totalPages = 0;
+			unsigned long long residentPages = 0;
+			FILE* statm = fopen("/proc/self/statm", "r");
+			if (statm != nullptr)
+			{
+				if (fscanf(statm, "%llu %llu", &totalPages, &residentPages) != 2) {
+					residentPages = 0;
+				}
+				
+				fclose(statm);
+			}
+			
+			return (uint64_t)(residentPages) * (uint64_t)(sysconf(_SC_PAGESIZE));
+			#else
+			return 0;
+			#endif
+		}
+		
+		//Returns the peak resident set size of the process in bytes, or zero if it cannot be determined on this platform
+		static inline uint64_t peakResidentBytes()
+		{
+			#if defined(__unix__) || defined(__APPLE__)
+			struct rusage usage;
+			if (getrusage(RUSAGE_SELF, &usage) != 0) {
+				return 0;
+			}
+			
+			//macOS reports the peak in bytes, whereas other platforms report it in kilobytes
+			#if defined(__APPLE__)
+			return (uint64_t)(usage.ru_maxrss);
+			#else
+			return (uint64_t)(usage.ru_maxrss) * 1024;
+			#endif
+			#else
+			return 0;
+			#endif
+		}
+};
+
+//Sets the maximum size of the GDAL block cache, restoring the previous maximum when the object is destroyed
+//(The block cache is shared by the whole process, so concurrent merges in the same process share the most recent limit)
+class ScopedCacheLimit
+{
+	public:
+		
+		inline ScopedCacheLimit(uint64_t cacheBytes) : previous(GDALGetCacheMax64()) {
+			GDALSetCacheMax64((GIntBig)(cacheBytes));
+		}
+		
+		inline ~ScopedCacheLimit() {
+			GDALSetCacheMax64(this->previous);
+		}
+		
+		//ScopedCacheLimit objects cannot be copied
+		ScopedCacheLimit(const ScopedCacheLimit& other) = delete;
+		ScopedCacheLimit& operator=(const ScopedCacheLimit& other) = delete;
+		
+	private:
+		GIntBig previous;
+};
+
+//Divides a memory budget between the GDAL block cache and the tile buffers of a merge, and throttles the merge if it exceeds the budget
+//(The budget covers the resident set size of the whole process, including any memory in use before the merge started)
+class MemoryBudget
+{
+	public:
+		
+		//Creates a budget of the specified number of bytes (zero represents an unlimited budget)
+		inline MemoryBudget(uint64_t budgetBytes) : budgetBytes(budgetBytes), baselineBytes(MemoryUsage::currentResidentBytes()) {}
+		
+		//Determines if the budget is limited
+		inline bool limited() const {
+			return this->budgetBytes > 0;
+		}
+		
+		//Returns the size of the budget in bytes
+		inline uint64_t bytes() const {
+			return this->budgetBytes;
+		}
+		
+		//Returns the size of the GDAL block cache for the budget, which is a quarter of the memory available to the merge
+		//but always large enough for the specified number of output blocks (zero if the budget is unlimited)
+		inline uint64_t cacheBytes(uint64_t blockBytes, uint64_t minimumBlocks = 4) const
+		{
+			if (this->limited() == false) {
+				return 0;
+			}
+			
+			return std::max<uint64_t>(this->available() / 4, blockBytes * minimumBlocks);
+		}
+		
+		//Returns the number of tiles that can be in flight at once, given the memory required by each tile and the size of the block cache
+		//(Returns zero if not even a single tile fits within the budget, and the requested number if the budget is unlimited)
+		inline uint64_t tilesInFlight(uint64_t requested, uint64_t tileBytes, uint64_t cacheBytes) const
+		{
+			if (this->limited() == false) {
+				return requested;
+			}
+			
+			//Reserve a tenth of the available memory for allocator overheads and the state of GDAL and its drivers
+			uint64_t available = this->available();
+			uint64_t usable = (available > cacheBytes) ? ((available - cacheBytes) / 10) * 9 : 0;
+			return std::min<uint64_t>(requested, usable / std::max<uint64_t>(1, tileBytes));
+		}
+		
+		//Determines if the specified number of bytes fits within half of the memory available to the merge (never true if the budget is unlimited)
+		inline bool canReserve(uint64_t bytes) const {
+			return this->limited() && bytes <= this->available() / 2;
+		}
+		
+		//Excludes the specified number of bytes from the memory available to the block cache and the tile buffers
+		inline void reserve(uint64_t bytes) {
+			this->baselineBytes += bytes;
+		}
+		
+		//Determines if the resident set size of the process is currently within the budget
+		//(Always returns true if the budget is unlimited or the resident set size cannot be determined on this platform)
+		inline bool withinBudget() const
+		{
+			uint64_t current = (this->limited() == true) ? MemoryUsage::currentResidentBytes() : 0;
+			return current <= this->budgetBytes;
+		}
+		
+	private:
+		
+		//Returns the memory available to the merge, excluding the memory already in use when the budget was created
+		inline uint64_t available() const {
+			return (this->budgetBytes > this->baselineBytes) ? this->budgetBytes - this->baselineBytes : 0;
+		}
+		
+		uint64_t budgetBytes;
+		uint64_t baselineBytes;
+};
+
+} //End namespace mergetiff
+
+#endif
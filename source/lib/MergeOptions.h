@@ -0,0 +1,185 @@
+#ifndef _MERGETIFF_MERGE_OPTIONS
+#define _MERGETIFF_MERGE_OPTIONS
+
+#include "DatatypeConversion.h"
+#include "DriverOptions.h"
+#include "PyramidReduction.h"
+
+#include <gdal.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace mergetiff {
+
+//The strategies available for performing merge operations
+enum class MergeEngine
+{
+	//Reads and writes the output in tiles aligned to the output block size, using a pool of worker threads
+	Tiled,
+	
+	//Builds a VRT dataset and copies it with the GeoTiff driver's CreateCopy() method (single-threaded reads)
+	VRT
+};
+
+//The strategies available for aligning input bands whose georeferenced grids differ
+enum class GridAlignment
+{
+	//All input bands are assumed to share the same pixel grid
+	None,
+	
+	//The output uses the grid of the first input band
+	FirstInput,
+	
+	//The output covers the union of the input band extents, at the resolution of the first input band
+	Union,
+	
+	//The output covers the intersection of the input band extents, at the resolution of the first input band
+	Intersection
+};
+
+//The file formats that merged datasets can be written in
+enum class OutputFormat
+{
+	//A tiled GeoTiff without overviews
+	GeoTiff,
+	
+	//A Cloud Optimized GeoTiff, with internal overviews generated during the merge (requires the tiled engine)
+	COG
+};
+
+//The block structures available for the output dataset
+enum class BlockLayout
+{
+	//Selects the layout based on the declared access pattern
+	Auto,
+	
+	//Square tiles with the width and height of the block size
+	Tiled,
+	
+	//Full-width strips with the height of the block size
+	Striped
+};
+
+//The ways in which the bands of the output dataset can be interleaved
+enum class Interleave
+{
+	//Selects the interleaving based on the declared access pattern (and uses band interleaving whenever compressed tiles are copied)
+	Auto,
+	
+	//All of the bands of a pixel are stored together, so each block contains every band
+	Pixel,
+	
+	//Each band is stored separately, so each block contains a single band
+	Band
+};
+
+//The ways in which downstream consumers can declare that they will read the output dataset, used to select the layout
+enum class AccessPattern
+{
+	//The whole dataset is read sequentially, including all of its bands (tiled, pixel-interleaved, 512x512 automatic blocks)
+	FullScan,
+	
+	//Bands are read individually, either in full or in windows (tiled, band-interleaved, 512x512 automatic blocks)
+	PerBand,
+	
+	//Small windows are read from arbitrary locations, including all of their bands (tiled, pixel-interleaved, 256x256 automatic blocks)
+	RandomWindow
+};
+
+//Controls the behaviour of DatasetManagement::createMergedDataset()
+class MergeOptions
+{
+	public:
+		
+		MergeOptions() :
+			engine(MergeEngine::Tiled),
+			numThreads(0),
+			blockSize(256),
+			tilesInFlight(0),
+			outputType(GDT_Unknown),
+			alignment(GridAlignment::None),
+			resampling(GRIORA_NearestNeighbour),
+			format(OutputFormat::GeoTiff),
+			overviewResampling(OverviewResampling::Average),
+			copyCompressedTiles(true),
+			blockLayout(BlockLayout::Auto),
+			interleave(Interleave::Auto),
+			accessPattern(AccessPattern::FullScan),
+			memoryBudget(0),
+			sparseOutput(true),
+			computeStatistics(false)
+		{}
+		
+		//The merge strategy to use
+		MergeEngine engine;
+		
+		//The number of worker threads used to read input tiles (zero selects the number of hardware threads)
+		unsigned int numThreads;
+		
+		//The width and height of the output tiles, which must be a multiple of 16, or the height of the output strips for striped layouts
+		//(Zero selects the block size based on the declared access pattern)
+		unsigned int blockSize;
+		
+		//The maximum number of tiles that can be read ahead of the writer (zero selects twice the number of threads)
+		unsigned int tilesInFlight;
+		
+		//The datatype of the output dataset (GDT_Unknown selects the smallest type that can represent all of the input bands)
+		//(Bands whose datatype differs from the output datatype are converted on the fly, which requires the tiled engine)
+		GDALDataType outputType;
+		
+		//The transformation applied to the values of each output band when it is converted, indexed by output band
+		//(Bands beyond the end of the list are converted without any scaling, offset or clamping)
+		std::vector<DatatypeConversion::ValueTransform> bandTransforms;
+		
+		//The arithmetic expressions of computed bands, which are appended to the output after the input bands (requires the tiled engine)
+		//(For example, "(b4-b3)/(b4+b3)", where bN refers to the Nth input band after any conversion and transformation. See BandExpression for the syntax.
+		// Each expression is evaluated from the tiles of the input bands while they are in memory, so computed bands require no additional reads.)
+		std::vector<std::string> bandExpressions;
+		
+		//How input bands with differing extents or resolutions are aligned to a common grid (requires the tiled engine)
+		//(Alignment uses each band's geotransform and assumes that all of the input bands share the same projection)
+		GridAlignment alignment;
+		
+		//The resampling algorithm used when an input band's resolution differs from that of the output grid
+		GDALRIOResampleAlg resampling;
+		
+		//The file format of the output dataset
+		OutputFormat format;
+		
+		//The compression settings for the output dataset (CompressionCodec::Auto compresses a sample of the input tiles with each candidate codec)
+		CompressionProfile compression;
+		
+		//The resampling algorithm used to generate overview levels for Cloud Optimized GeoTiff output
+		OverviewResampling overviewResampling;
+		
+		//Whether the compressed tiles of GeoTiff input bands whose block size, codec, predictor and datatype match the output are copied
+		//directly into the output without being decoded (the output is band-interleaved whenever any tiles are copied, and COG output never copies tiles)
+		bool copyCompressedTiles;
+		
+		//The block structure of the output dataset
+		BlockLayout blockLayout;
+		
+		//The interleaving of the bands of the output dataset
+		Interleave interleave;
+		
+		//How the output dataset will be read, which determines the layout, interleaving and block size when they are not specified
+		AccessPattern accessPattern;
+		
+		//The maximum resident memory of the process during the merge in bytes, which sizes the GDAL block cache and the number of tiles in flight
+		//(Zero places no limit on memory usage. The merge fails if the budget cannot accommodate a single tile, and is throttled if the budget is exceeded)
+		uint64_t memoryBudget;
+		
+		//Whether the output omits the blocks of output tiles that contain nothing but "no data", which GDAL then reads as the band's "no data" value
+		//(Such tiles are never written regardless, and GDAL fills their blocks when the dataset is closed unless the output is sparse.
+		// Input tiles that GDAL reports as empty are never read either way.)
+		bool sparseOutput;
+		
+		//Whether the statistics and histogram of each output band are computed from the tiles as they are merged and stored in the output's metadata
+		//(Requires the tiled engine. Bands whose compressed tiles are copied directly are never decoded, so they have no statistics.)
+		bool computeStatistics;
+};
+
+} //End namespace mergetiff
+
+#endif
@@ -0,0 +1,235 @@
+#ifndef _MERGETIFF_MERGE_STATS
+#define _MERGETIFF_MERGE_STATS
+
+#include "BandStatistics.h"
+
+#include <stdint.h>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace mergetiff {
+
+//Measures elapsed wall time
+class Stopwatch
+{
+	public:
+		
+		Stopwatch() : start(std::chrono::steady_clock::now()) {}
+		
+		//Returns the number of seconds since the stopwatch was created or last restarted
+		inline double elapsed() const {
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - this->start).count();
+		}
+		
+		//Restarts the stopwatch, returning the number of seconds that had elapsed
+		inline double restart()
+		{
+			double seconds = this->elapsed();
+			this->start = std::chrono::steady_clock::now();
+			return seconds;
+		}
+		
+	private:
+		std::chrono::steady_clock::time_point start;
+};
+
+//Performance statistics for a merge operation, populated by DatasetManagement::createMergedDataset() when requested
+class MergeStats
+{
+	public:
+		
+		//The statistics for an individual input file
+		class InputStats
+		{
+			public:
+				
+				InputStats() : bytesRead(0) {}
+				InputStats(const std::string& filename) : filename(filename), bytesRead(0) {}
+				
+				std::string filename;
+				
+				//The number of bytes of pixel data read from the file, in the datatype of each band (plus the size of any compressed tiles that were copied)
+				uint64_t bytesRead;
+		};
+		
+		MergeStats() :
+			openSeconds(0.0),
+			metadataSeconds(0.0),
+			readSeconds(0.0),
+			encodeSeconds(0.0),
+			writeSeconds(0.0),
+			flushSeconds(0.0),
+			totalSeconds(0.0),
+			bytesWritten(0),
+			tilesProcessed(0),
+			tilesCopied(0),
+			tilesSkipped(0),
+			threads(0),
+			workerWallSeconds(0.0),
+			peakMemoryBytes(0)
+		{}
+		
+		//Returns the statistics for the specified input file, adding an entry for it if there is none
+		inline InputStats& input(const std::string& filename)
+		{
+			for (auto& input : this->inputs)
+			{
+				if (input.filename == filename) {
+					return input;
+				}
+			}
+			
+			this->inputs.push_back(InputStats(filename));
+			return this->inputs.back();
+		}
+		
+		//Returns the total number of bytes read from all of the input files
+		inline uint64_t bytesRead() const
+		{
+			uint64_t total = 0;
+			for (auto& input : this->inputs) {
+				total += input.bytesRead;
+			}
+			
+			return total;
+		}
+		
+		//Returns the fraction of the time that the worker threads were available that they spent reading and converting tiles
+		inline double threadUtilisation() const
+		{
+			double available = this->workerWallSeconds * this->threads;
+			return (available > 0.0) ? this->readSeconds / available : 0.0;
+		}
+		
+		//Serialises the statistics to a JSON object
+		inline std::string toJson() const
+		{
+			std::string json = "{\n";
+			json += "  \"phases\": {\n";
+			json += "    \"open\": " + MergeStats::number(this->openSeconds) + ",\n";
+			json += "    \"metadata\": " + MergeStats::number(this->metadataSeconds) + ",\n";
+			json += "    \"read\": " + MergeStats::number(this->readSeconds) + ",\n";
+			json += "    \"encode\": " + MergeStats::number(this->encodeSeconds) + ",\n";
+			json += "    \"write\": " + MergeStats::number(this->writeSeconds) + ",\n";
+			json += "    \"flush\": " + MergeStats::number(this->flushSeconds) + "\n";
+			json += "  },\n";
+			json += "  \"totalSeconds\": " + MergeStats::number(this->totalSeconds) + ",\n";
+			json += "  \"inputs\": [";
+			for (size_t index = 0; index < this->inputs.size(); ++index)
+			{
+				json += (index > 0) ? ",\n" : "\n";
+				json += "    {\"filename\": " + MergeStats::quote(this->inputs[index].filename) + ", \"bytesRead\": " + std::to_string(this->inputs[index].bytesRead) + "}";
+			}
+			json += this->inputs.empty() ? "],\n" : "\n  ],\n";
+			json += "  \"bytesRead\": " + std::to_string(this->bytesRead()) + ",\n";
+			json += "  \"bytesWritten\": " + std::to_string(this->bytesWritten) + ",\n";
+			json += "  \"readMBps\": " + MergeStats::number(MergeStats::throughput(this->bytesRead(), this->totalSeconds)) + ",\n";
+			json += "  \"writeMBps\": " + MergeStats::number(MergeStats::throughput(this->bytesWritten, this->totalSeconds)) + ",\n";
+			json += "  \"tilesProcessed\": " + std::to_string(this->tilesProcessed) + ",\n";
+			json += "  \"tilesCopied\": " + std::to_string(this->tilesCopied) + ",\n";
+			json += "  \"tilesSkipped\": " + std::to_string(this->tilesSkipped) + ",\n";
+			json += "  \"threads\": " + std::to_string(this->threads) + ",\n";
+			json += "  \"threadUtilisation\": " + MergeStats::number(this->threadUtilisation()) + ",\n";
+			json += "  \"peakMemoryBytes\": " + std::to_string(this->peakMemoryBytes) + ",\n";
+			json += "  \"bandStatistics\": [";
+			for (size_t index = 0; index < this->bandStatistics.size(); ++index)
+			{
+				const BandStatistics& band = this->bandStatistics[index];
+				json += (index > 0) ? ",\n" : "\n";
+				json += "    {\"band\": " + std::to_string(index + 1) + ", \"validPixels\": " + std::to_string(band.validPixels);
+				if (band.valid() == true)
+				{
+					json += ", \"min\": " + MergeStats::number(band.minimum) + ", \"max\": " + MergeStats::number(band.maximum);
+					json += ", \"mean\": " + MergeStats::number(band.mean) + ", \"stddev\": " + MergeStats::number(band.stddev);
+				}
+				json += "}";
+			}
+			json += this->bandStatistics.empty() ? "]\n" : "\n  ]\n";
+			json += "}";
+			return json;
+		}
+		
+		//The wall time spent in each phase of the merge, in seconds:
+		//- open: opening the input datasets (measured by the caller, since the inputs are opened before the merge starts)
+		//- metadata: creating the output dataset and copying the dataset and band metadata
+		//- read: reading, converting and aligning input tiles (and computing their overviews), summed across the worker threads
+		//- encode: passing finished tiles to GDAL, which compresses each output block as it is completed
+		//- write: copying compressed input tiles into the output, and copying the intermediate file for Cloud Optimized GeoTiffs
+		//- flush: flushing and closing the output dataset
+		double openSeconds;
+		double metadataSeconds;
+		double readSeconds;
+		double encodeSeconds;
+		double writeSeconds;
+		double flushSeconds;
+		
+		//The wall time of the whole merge, in seconds (including the open phase if the caller measured it)
+		double totalSeconds;
+		
+		//The statistics for each of the input files
+		std::vector<InputStats> inputs;
+		
+		//The size of the output file in bytes
+		uint64_t bytesWritten;
+		
+		//The number of output tiles that were read and written through GDAL, and the number of compressed tiles that were copied directly
+		uint64_t tilesProcessed;
+		uint64_t tilesCopied;
+		
+		//The number of output tiles that were left unwritten because every decoded band contained nothing but "no data"
+		uint64_t tilesSkipped;
+		
+		//The number of worker threads, and the wall time of the tile loop during which they were available to read tiles
+		unsigned int threads;
+		double workerWallSeconds;
+		
+		//The peak resident memory of the process in bytes (zero if it cannot be determined on this platform)
+		uint64_t peakMemoryBytes;
+		
+		//The statistics of each output band, if MergeOptions::computeStatistics was set (bands whose tiles were copied directly have no valid pixels)
+		std::vector<BandStatistics> bandStatistics;
+		
+	private:
+		
+		//Formats a floating-point value for JSON output
+		static inline std::string number(double value)
+		{
+			char buffer[64];
+			snprintf(buffer, sizeof(buffer), "%.6f", value);
+			return std::string(buffer);
+		}
+		
+		//Quotes and escapes a string for JSON output
+		static inline std::string quote(const std::string& value)
+		{
+			std::string quoted = "\"";
+			for (char c : value)
+			{
+				if (c == '"' || c == '\\') {
+					quoted += std::string("\\") + c;
+				}
+				else if ((unsigned char)(c) < 0x20)
+				{
+					char buffer[8];
+					snprintf(buffer, sizeof(buffer), "\\u%04x", (unsigned int)(c));
+					quoted += buffer;
+				}
+				else {
+					quoted += c;
+				}
+			}
+			
+			return quoted + "\"";
+		}
+		
+		//Computes a throughput in megabytes per second
+		static inline double throughput(uint64_t bytes, double seconds) {
+			return (seconds > 0.0) ? ((double)(bytes) / (1024.0 * 1024.0)) / seconds : 0.0;
+		}
+};
+
+} //End namespace mergetiff
+
+#endif
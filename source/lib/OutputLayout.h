@@ -0,0 +1,78 @@
+#ifndef _MERGETIFF_OUTPUT_LAYOUT
+#define _MERGETIFF_OUTPUT_LAYOUT
+
+#include "ArgsArray.h"
+#include "MergeOptions.h"
+
+#include <string>
+
+namespace mergetiff {
+
+//Represents the block structure and band interleaving of an output dataset, with any automatic selections resolved
+class OutputLayout
+{
+	public:
+		
+		OutputLayout() : tiled(true), blockSize(256), bandInterleaved(false) {}
+		
+		//Resolves the layout requested by the supplied merge options, selecting any unspecified settings based on the declared access pattern
+		static inline OutputLayout resolve(const MergeOptions& options)
+		{
+			OutputLayout layout;
+			layout.tiled = (options.blockLayout != BlockLayout::Striped);
+			
+			//Reading bands individually is only efficient when each block contains a single band
+			if (options.interleave == Interleave::Auto) {
+				layout.bandInterleaved = (options.accessPattern == AccessPattern::PerBand);
+			}
+			else {
+				layout.bandInterleaved = (options.interleave == Interleave::Band);
+			}
+			
+			//Small blocks minimise the data that is decoded but discarded by reads of small windows, whereas large blocks minimise per-block overheads
+			if (options.blockSize != 0) {
+				layout.blockSize = options.blockSize;
+			}
+			else {
+				layout.blockSize = (options.accessPattern == AccessPattern::RandomWindow) ? 256 : 512;
+			}
+			
+			return layout;
+		}
+		
+		//Returns the width of the blocks for a dataset of the specified width
+		int blockWidth(int datasetWidth) const {
+			return this->tiled ? (int)(this->blockSize) : datasetWidth;
+		}
+		
+		//Returns the height of the blocks
+		int blockHeight() const {
+			return (int)(this->blockSize);
+		}
+		
+		//Adds the GeoTiff creation options that describe the layout
+		void addCreationOptions(ArgsArray& options) const
+		{
+			if (this->tiled == true)
+			{
+				options.add("TILED=YES");
+				options.add("BLOCKXSIZE=" + std::to_string(this->blockSize));
+			}
+			
+			options.add("BLOCKYSIZE=" + std::to_string(this->blockSize));
+			options.add(this->bandInterleaved ? "INTERLEAVE=BAND" : "INTERLEAVE=PIXEL");
+		}
+		
+		//Whether the dataset is tiled rather than striped
+		bool tiled;
+		
+		//The width and height of the tiles, or the height of the strips
+		unsigned int blockSize;
+		
+		//Whether the bands are interleaved by band rather than by pixel
+		bool bandInterleaved;
+};
+
+} //End namespace mergetiff
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef _MERGETIFF_PYRAMID_REDUCTION
+#define _MERGETIFF_PYRAMID_REDUCTION
+
+#include "DatatypeConversion.h"
+
+#include <stdint.h>
+
+namespace mergetiff {
+
+//The resampling algorithms available for generating overview levels
+enum class OverviewResampling
+{
+	//Each overview pixel is the mean of the valid pixels it covers
+	Average,
+	
+	//Each overview pixel is the top-left pixel it covers
+	Nearest
+};
+
+class PyramidReduction
+{
+	public:
+		
+		//Returns the size of a dimension after reducing it by the specified factor
+		static inline int reducedSize(int size, int factor) {
+			return (size + factor - 1) / factor;
+		}
+		
+		//Downsamples a single band of raster data by a factor of two in each dimension, ignoring pixels that contain the "no data" value
+		//(Pixels beyond the right and bottom edges are treated as missing, so odd dimensions round up)
+		template <typename PrimitiveTy>
+		static inline void reduceBand(const PrimitiveTy* input, int width, int height, PrimitiveTy* output, OverviewResampling resampling, bool hasNoData, PrimitiveTy noDataValue)
+		{
+			int outWidth = PyramidReduction::reducedSize(width, 2);
+			int outHeight = PyramidReduction::reducedSize(height, 2);
+			for (int y = 0; y < outHeight; ++y)
+			{
+				const PrimitiveTy* row0 = input + ((uint64_t)(y * 2) * width);
+				const PrimitiveTy* row1 = (y * 2 + 1 < height) ? row0 + width : nullptr;
+				PrimitiveTy* outRow = output + ((uint64_t)(y) * outWidth);
+				
+				//Nearest neighbour simply picks the top-left pixel of each 2x2 block
+				if (resampling == OverviewResampling::Nearest)
+				{
+					for (int x = 0; x < outWidth; ++x) {
+						outRow[x] = row0[x * 2];
+					}
+					
+					continue;
+				}
+				
+				//Average the valid pixels of each 2x2 block
+				for (int x = 0; x < outWidth; ++x)
+				{
+					double sum = 0.0;
+					int count = 0;
+					int limit = (x * 2 + 1 < width) ? 2 : 1;
+					for (int dx = 0; dx < limit; ++dx)
+					{
+						PrimitiveTy top = row0[x * 2 + dx];
+						if (PyramidReduction::isValid(top, hasNoData, noDataValue))
+						{
+							sum += (double)(top);
+							++count;
+						}
+						
+						if (row1 != nullptr)
+						{
+							PrimitiveTy bottom = row1[x * 2 + dx];
+							if (PyramidReduction::isValid(bottom, hasNoData, noDataValue))
+							{
+								sum += (double)(bottom);
+								++count;
+							}
+						}
+					}
+					
+					outRow[x] = (count > 0) ? DatatypeConversion::saturate<PrimitiveTy>(sum / count) : noDataValue;
+				}
+			}
+		}
+		
+	private:
+		
+		//Determines if a pixel value is valid (i.e. not the "no data" value, with NaN matching a NaN sentinel)
+		template <typename PrimitiveTy>
+		static inline bool isValid(PrimitiveTy value, bool hasNoData, PrimitiveTy noDataValue) {
+			return !hasNoData || !(value == noDataValue || (value != value && noDataValue != noDataValue));
+		}
+};
+
+} //End namespace mergetiff
+
+#endif
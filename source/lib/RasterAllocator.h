@@ -0,0 +1,175 @@
+#ifndef _MERGETIFF_RASTER_ALLOCATOR
+#define _MERGETIFF_RASTER_ALLOCATOR
+
+#include "LibrarySettings.h"
+
+#include <stdint.h>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace mergetiff {
+
+//Allocates and frees the buffers of RasterData objects
+class RasterAllocator
+{
+	public:
+		
+		virtual ~RasterAllocator() {}
+		
+		//Allocates a buffer of the specified size in bytes, returning nullptr on failure
+		virtual void* allocate(uint64_t bytes) = 0;
+		
+		//Frees a buffer of the specified size that was previously returned by allocate()
+		virtual void deallocate(void* buffer, uint64_t bytes) = 0;
+		
+		//Allocates a buffer aligned to MERGETIFF_BUFFER_ALIGNMENT bytes, returning nullptr on failure
+		//(If requested, buffers of at least 2MB are aligned to 2MB and the kernel is advised to back them with transparent huge pages where supported)
+		static inline void* allocateAligned(uint64_t bytes, bool hugePages = false)
+		{
+			const uint64_t hugePageSize = 2 * 1024 * 1024;
+			size_t alignment = (hugePages && bytes >= hugePageSize) ? hugePageSize : MERGETIFF_BUFFER_ALIGNMENT;
+			
+			#if defined(_WIN32)
+			return _aligned_malloc((size_t)(bytes), alignment);
+			#else
+			void* buffer = nullptr;
+			if (posix_memalign(&buffer, alignment, (size_t)(bytes)) != 0) {
+				return nullptr;
+			}
+			
+			#if defined(MADV_HUGEPAGE)
+			if (alignment == hugePageSize) {
+				madvise(buffer, (size_t)(bytes), MADV_HUGEPAGE);
+			}
+			#endif
+			
+			return buffer;
+			#endif
+		}
+		
+		//Frees a buffer that was allocated by allocateAligned()
+		static inline void freeAligned(void* buffer)
+		{
+			#if defined(_WIN32)
+			_aligned_free(buffer);
+			#else
+			free(buffer);
+			#endif
+		}
+};
+
+//Allocates cache-line aligned buffers, without retaining them once they are freed
+class AlignedAllocator : public RasterAllocator
+{
+	public:
+		
+		//Creates an allocator, optionally requesting transparent huge pages for large buffers
+		AlignedAllocator(bool hugePages = false) : hugePages(hugePages) {}
+		
+		virtual void* allocate(uint64_t bytes) {
+			return RasterAllocator::allocateAligned(bytes, this->hugePages);
+		}
+		
+		virtual void deallocate(void* buffer, uint64_t) {
+			RasterAllocator::freeAligned(buffer);
+		}
+		
+	private:
+		bool hugePages;
+};
+
+//Allocates cache-line aligned buffers and retains them once they are freed, reusing them for later allocations of the same size
+//(This avoids repeatedly allocating, page faulting and freeing large buffers when many rasters of the same shape are processed in turn.
+// The pool can be shared by multiple threads, and must outlive every RasterData object whose buffer it allocated.)
+class RasterBufferPool : public RasterAllocator
+{
+	public:
+		
+		//Creates a pool that retains at most the specified number of bytes of freed buffers (zero retains every freed buffer),
+		//optionally requesting transparent huge pages for large buffers
+		RasterBufferPool(uint64_t maxRetainedBytes = 0, bool hugePages = false) : maxRetainedBytes(maxRetainedBytes), hugePages(hugePages), retained(0) {}
+		
+		//RasterBufferPool objects cannot be copied
+		RasterBufferPool(const RasterBufferPool& other) = delete;
+		RasterBufferPool& operator=(const RasterBufferPool& other) = delete;
+		
+		//Frees all of the retained buffers
+		virtual ~RasterBufferPool() {
+			this->clear();
+		}
+		
+		//Returns a retained buffer of the specified size if there is one, or allocates a new buffer otherwise
+		virtual void* allocate(uint64_t bytes)
+		{
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				auto available = this->buffers.find(bytes);
+				if (available != this->buffers.end() && available->second.empty() == false)
+				{
+					void* buffer = available->second.back();
+					available->second.pop_back();
+					this->retained -= bytes;
+					return buffer;
+				}
+			}
+			
+			return RasterAllocator::allocateAligned(bytes, this->hugePages);
+		}
+		
+		//Retains a buffer for reuse, or frees it if retaining it would exceed the limit
+		virtual void deallocate(void* buffer, uint64_t bytes)
+		{
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				if (this->maxRetainedBytes == 0 || this->retained + bytes <= this->maxRetainedBytes)
+				{
+					this->buffers[bytes].push_back(buffer);
+					this->retained += bytes;
+					return;
+				}
+			}
+			
+			RasterAllocator::freeAligned(buffer);
+		}
+		
+		//Returns the total size in bytes of the buffers that are currently retained
+		uint64_t retainedBytes()
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			return this->retained;
+		}
+		
+		//Frees all of the retained buffers
+		void clear()
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			for (auto& size : this->buffers)
+			{
+				for (auto buffer : size.second) {
+					RasterAllocator::freeAligned(buffer);
+				}
+			}
+			
+			this->buffers.clear();
+			this->retained = 0;
+		}
+		
+	private:
+		uint64_t maxRetainedBytes;
+		bool hugePages;
+		uint64_t retained;
+		std::map< uint64_t, std::vector<void*> > buffers;
+		std::mutex mutex;
+};
+
+} //End namespace mergetiff
+
+#endif
@@ -0,0 +1,231 @@
+#ifndef _MERGETIFF_RASTER_BLOCK_STREAM
+#define _MERGETIFF_RASTER_BLOCK_STREAM
+
+#include "BandReaderPool.h"
+#include "DatatypeConversion.h"
+#include "ErrorHandling.h"
+#include "RasterData.h"
+#include "RasterIO.h"
+#include "RasterWindow.h"
+#include "SmartPointers.h"
+#include "ThreadPool.h"
+
+#include <gdal.h>
+#include <gdal_priv.h>
+#include <stdint.h>
+#include <algorithm>
+#include <future>
+#include <vector>
+
+namespace mergetiff {
+
+//Reads raster bands one block at a time in row-major order, so that rasters of any size can be processed in constant memory
+//(The next block is read on a background thread while the current block is being processed, using separate GDAL handles where possible)
+//Usage: `RasterWindow window; while (stream.next(window)) { process(stream.block(), window); }`
+template <typename PrimitiveTy>
+class RasterBlockStream
+{
+	public:
+		
+		//Creates a stream over the supplied raster bands, which may belong to different datasets but must all have the same dimensions
+		//(Each block contains one channel per band. A block size of zero selects the native block size of the first band.)
+		RasterBlockStream(const std::vector<GDALRasterBand*>& bands, int blockWidth = 0, int blockHeight = 0) :
+			bands(bands),
+			blocks(0, 0, 1, 1),
+			nextBlock(0),
+			interleaved(false),
+			readers(bands, 1),
+			pool(1)
+		{
+			if (bands.empty()) {
+				return;
+			}
+			
+			//Divide the bands into blocks, defaulting to the native block size of the first band
+			TileGrid nativeBlocks = RasterIO::nativeBlockGrid(bands[0]);
+			this->blocks = TileGrid(
+				bands[0]->GetXSize(),
+				bands[0]->GetYSize(),
+				(blockWidth > 0) ? blockWidth : nativeBlocks.tileWidth,
+				(blockHeight > 0) ? blockHeight : nativeBlocks.tileHeight
+			);
+			
+			//Bands that all belong to the same pixel-interleaved dataset are read with a single dataset-level read per block
+			GDALDataset* dataset = bands[0]->GetDataset();
+			this->interleaved = (bands.size() > 1 && dataset != nullptr && RasterIO::isPixelInterleaved(dataset));
+			for (auto band : bands) {
+				this->interleaved = this->interleaved && band->GetDataset() == dataset;
+			}
+			
+			//Allocate the two buffers that alternate between being processed and being prefetched, then start reading the first block
+			uint64_t blockElements = (uint64_t)(this->blocks.tileWidth) * this->blocks.tileHeight * bands.size();
+			this->buffers[0].resize(blockElements);
+			this->buffers[1].resize(blockElements);
+			this->prefetch();
+		}
+		
+		//RasterBlockStream objects cannot be copied
+		RasterBlockStream(const RasterBlockStream& other) = delete;
+		RasterBlockStream& operator=(const RasterBlockStream& other) = delete;
+		
+		//Returns the grid of blocks that the stream reads, in row-major order
+		const TileGrid& grid() const {
+			return this->blocks;
+		}
+		
+		//Returns the total number of blocks in the stream
+		uint64_t numBlocks() const {
+			return this->bands.empty() ? 0 : this->blocks.numTiles();
+		}
+		
+		//Advances to the next block, storing the window that it covers and returning false once every block has been read
+		bool next(RasterWindow& window)
+		{
+			if (this->nextBlock >= this->numBlocks()) {
+				return false;
+			}
+			
+			//Wait for the block to finish being read
+			if (this->pending.get() == false) {
+				return ErrorHandling::handleError<bool>("failed to read block " + std::to_string(this->nextBlock) + " from GDAL raster band");
+			}
+			
+			//Wrap the block's buffer without copying it
+			window = this->blocks.window(this->nextBlock);
+			this->current = RasterData<PrimitiveTy>(this->buffers[this->nextBlock % 2].data(), this->bands.size(), window.height, window.width, true);
+			
+			//Start reading the following block into the other buffer, which the caller has finished processing
+			this->nextBlock += 1;
+			this->prefetch();
+			return true;
+		}
+		
+		//Returns the current block, with one channel per band
+		//(The block's buffer is reused, so it is only valid until the next call to next(). Edge blocks are smaller than the others.)
+		RasterData<PrimitiveTy>& block() {
+			return this->current;
+		}
+		
+	private:
+		
+		//Starts reading the next block on the background thread, if there are any blocks remaining
+		void prefetch()
+		{
+			if (this->nextBlock >= this->numBlocks()) {
+				return;
+			}
+			
+			RasterWindow window = this->blocks.window(this->nextBlock);
+			PrimitiveTy* buffer = this->buffers[this->nextBlock % 2].data();
+			this->pending = this->pool.submit([this, window, buffer]() -> bool
+			{
+				GDALDataType dtype = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
+				uint64_t numChannels = this->bands.size();
+				GSpacing pixelSpace = sizeof(PrimitiveTy) * numChannels;
+				GSpacing lineSpace = pixelSpace * window.width;
+				BandReaderPool::Context* context = this->readers.acquire();
+				bool success = true;
+				if (this->interleaved == true) {
+					success = this->readers.readAllBands(context, window.x, window.y, window.width, window.height, buffer, dtype, pixelSpace, lineSpace, sizeof(PrimitiveTy));
+				}
+				else
+				{
+					for (size_t band = 0; band < numChannels && success; ++band) {
+						success = this->readers.read(context, band, window.x, window.y, window.width, window.height, buffer + band, window.width, window.height, dtype, pixelSpace, lineSpace);
+					}
+				}
+				
+				this->readers.release(context);
+				return success;
+			});
+		}
+		
+		std::vector<GDALRasterBand*> bands;
+		TileGrid blocks;
+		uint64_t nextBlock;
+		bool interleaved;
+		std::vector<PrimitiveTy> buffers[2];
+		RasterData<PrimitiveTy> current;
+		BandReaderPool readers;
+		std::future<bool> pending;
+		
+		//The pool is declared last so that it is destroyed first, completing any outstanding read before the buffers are released
+		ThreadPool pool;
+};
+
+//Writes blocks of raster data to a dataset, such as those produced by a RasterBlockStream, on a background thread
+//(Each block is copied before it is written, so the caller can reuse its buffer immediately. The dataset must not be used by the caller until finish() is called.)
+template <typename PrimitiveTy>
+class RasterBlockSink
+{
+	public:
+		
+		//Creates a sink that writes to the supplied dataset, whose bands correspond to the channels of each block
+		RasterBlockSink(GDALDatasetRef& dataset) : dataset(dataset), failed(false), pool(1) {}
+		
+		//RasterBlockSink objects cannot be copied
+		RasterBlockSink(const RasterBlockSink& other) = delete;
+		RasterBlockSink& operator=(const RasterBlockSink& other) = delete;
+		
+		//Waits for any outstanding write to complete
+		~RasterBlockSink() {
+			this->wait();
+		}
+		
+		//Queues a block to be written to the specified window of the dataset, waiting for the previous block to finish being written first
+		bool write(const RasterData<PrimitiveTy>& block, const RasterWindow& window)
+		{
+			if (this->wait() == false) {
+				return ErrorHandling::handleError<bool>("failed to write block to GDAL dataset");
+			}
+			
+			//Copy the block so that the caller's buffer can be reused while it is being written
+			uint64_t elements = block.channels() * block.rows() * block.cols();
+			this->buffer.resize(elements);
+			std::copy(block.getBuffer(), block.getBuffer() + elements, this->buffer.begin());
+			uint64_t channels = block.channels();
+			RasterLayout layout = block.layout();
+			this->pending = this->pool.submit([this, window, channels, layout]() -> bool
+			{
+				RasterData<PrimitiveTy> copy(this->buffer.data(), channels, window.height, window.width, true, layout);
+				return RasterIO::writeWindow<PrimitiveTy>(this->dataset, copy, window);
+			});
+			
+			return true;
+		}
+		
+		//Waits for any outstanding write to complete and flushes the dataset, returning false if any of the writes failed
+		bool finish()
+		{
+			if (this->wait() == false) {
+				return ErrorHandling::handleError<bool>("failed to write block to GDAL dataset");
+			}
+			
+			this->dataset->FlushCache();
+			return true;
+		}
+		
+	private:
+		
+		//Waits for the outstanding write, if any, returning false if any write has failed
+		bool wait()
+		{
+			if (this->pending.valid() && this->pending.get() == false) {
+				this->failed = true;
+			}
+			
+			return this->failed == false;
+		}
+		
+		GDALDatasetRef& dataset;
+		std::vector<PrimitiveTy> buffer;
+		std::future<bool> pending;
+		bool failed;
+		
+		//The pool is declared last so that it is destroyed first, completing any outstanding write before the buffer is released
+		ThreadPool pool;
+};
+
+} //End namespace mergetiff
+
+#endif
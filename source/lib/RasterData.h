@@ -2,35 +2,77 @@
 #define _MERGETIFF_RASTER_DATA
 
 #include "LibrarySettings.h"
+#include "RasterAllocator.h"
 
 #include <stdint.h>
+#include <utility>
 
 namespace mergetiff {
 
-//Stores raster pixel data in continuous row-major format
+//The memory layouts available for the channels of raster data
+enum class RasterLayout
+{
+	//The channels of each pixel are stored together (the default, which matches GDAL's pixel-interleaved layout)
+	Interleaved,
+	
+	//Each channel is stored as a complete row-major plane, one after another (band-sequential)
+	Planar
+};
+
+//Stores raster pixel data in continuous row-major format, with the channels either interleaved or stored as separate planes
 template <typename PrimitiveTy>
 class RasterData
 {
 	public:
 		
 		//Creates an empty object
-		RasterData() : _data(nullptr), _autoRelease(false), _channels(0), _rows(0), _cols(0) {}
+		RasterData() : _data(nullptr), _allocator(nullptr), _autoRelease(false), _layout(RasterLayout::Interleaved), _channels(0), _rows(0), _cols(0) {}
 		
 		//Creates a buffer with the specified dimensions
-		RasterData(uint64_t channels, uint64_t rows, uint64_t cols)
+		RasterData(uint64_t channels, uint64_t rows, uint64_t cols, RasterLayout layout = RasterLayout::Interleaved)
 		{
 			MERGETIFF_SMART_POINTER_RESET(this->_data, new PrimitiveTy[channels * rows * cols]);
+			this->_allocator = nullptr;
+			this->_autoRelease = false;
+			this->_layout = layout;
+			this->_channels = channels;
+			this->_rows = rows;
+			this->_cols = cols;
+		}
+		
+		//Creates a buffer with the specified dimensions using the supplied allocator, which the buffer is returned to when this object is destroyed
+		//(If no allocator is supplied then the buffer is allocated with new[], as per the constructor above. The buffer is invalid if allocation fails.)
+		RasterData(uint64_t channels, uint64_t rows, uint64_t cols, RasterAllocator* allocator, RasterLayout layout = RasterLayout::Interleaved)
+		{
+			uint64_t bytes = channels * rows * cols * sizeof(PrimitiveTy);
+			MERGETIFF_SMART_POINTER_RESET(this->_data, (allocator != nullptr) ? (PrimitiveTy*)(allocator->allocate(bytes)) : new PrimitiveTy[channels * rows * cols]);
+			this->_allocator = (this->_data) ? allocator : nullptr;
+			this->_autoRelease = false;
+			this->_layout = layout;
+			this->_channels = channels;
+			this->_rows = rows;
+			this->_cols = cols;
+		}
+		
+		//Takes ownership of an existing buffer with the specified dimensions that was allocated by the supplied allocator, which the buffer is returned to when this object is destroyed
+		RasterData(PrimitiveTy* buffer, uint64_t channels, uint64_t rows, uint64_t cols, RasterAllocator* allocator, RasterLayout layout = RasterLayout::Interleaved)
+		{
+			MERGETIFF_SMART_POINTER_RESET(this->_data, buffer);
+			this->_allocator = (buffer != nullptr) ? allocator : nullptr;
 			this->_autoRelease = false;
+			this->_layout = layout;
 			this->_channels = channels;
 			this->_rows = rows;
 			this->_cols = cols;
 		}
 		
 		//Takes ownership of an existing buffer with the specified dimensions, or simply wraps the buffer if autoRelease == true
-		RasterData(PrimitiveTy* buffer, uint64_t channels, uint64_t rows, uint64_t cols, bool autoRelease = false)
+		RasterData(PrimitiveTy* buffer, uint64_t channels, uint64_t rows, uint64_t cols, bool autoRelease = false, RasterLayout layout = RasterLayout::Interleaved)
 		{
 			MERGETIFF_SMART_POINTER_RESET(this->_data, buffer);
+			this->_allocator = nullptr;
 			this->_autoRelease = autoRelease;
+			this->_layout = layout;
 			this->_channels = channels;
 			this->_rows = rows;
 			this->_cols = cols;
@@ -41,26 +83,25 @@ class RasterData
 		RasterData& operator=(const RasterData& other) = delete;
 		
 		//Move constructor
-		RasterData(RasterData&& other) {
+		RasterData(RasterData&& other) : _data(nullptr), _allocator(nullptr), _autoRelease(false), _layout(RasterLayout::Interleaved), _channels(0), _rows(0), _cols(0) {
 			this->moveFrom(std::move(other));
 		}
 		
 		//Overloaded assignment operator for moving from another instance
 		RasterData& operator=(RasterData&& other)
 		{
-			this->moveFrom(std::move(other));
+			if (this != &other)
+			{
+				this->freeBuffer();
+				this->moveFrom(std::move(other));
+			}
+			
 			return *this;
 		}
 		
 		//Destructor
-		~RasterData()
-		{
-			//If we don't actually own the memory for the underlying buffer then relinquish it
-			//(Note: this unconventional behaviour was chosen to avoid introducing breaking API changes to mergetiff, which would
-			// have otherwise been necessary to accommodate variants of RasterData that use weak pointers / shared pointers / etc.)
-			if (this->_autoRelease == true) {
-				this->releaseBuffer();
-			}
+		~RasterData() {
+			this->freeBuffer();
 		}
 		
 		//Determines if the underlying buffer is valid
@@ -83,6 +124,26 @@ class RasterData
 			return this->_cols;
 		}
 		
+		//Returns the memory layout of the channels in the raster data
+		RasterLayout layout() const {
+			return this->_layout;
+		}
+		
+		//Returns the number of elements between adjacent pixels in the same row and channel
+		uint64_t pixelSpacing() const {
+			return (this->_layout == RasterLayout::Planar) ? 1 : this->_channels;
+		}
+		
+		//Returns the number of elements between adjacent rows in the same channel
+		uint64_t lineSpacing() const {
+			return this->_cols * this->pixelSpacing();
+		}
+		
+		//Returns the number of elements between the same pixel in adjacent channels
+		uint64_t channelSpacing() const {
+			return (this->_layout == RasterLayout::Planar) ? this->_rows * this->_cols : 1;
+		}
+		
 		//Retrieves a reference to the specified channel of the specified pixel
 		PrimitiveTy& pixelComponent(uint64_t y, uint64_t x, uint64_t channel) {
 			return this->_data[ this->index(y, x, channel) ];
@@ -103,9 +164,16 @@ class RasterData
 			return MERGETIFF_SMART_POINTER_GET(this->_data);
 		}
 		
+		//Returns the allocator that the underlying buffer will be returned to, or nullptr if it was not allocated by an allocator
+		RasterAllocator* allocator() const {
+			return this->_allocator;
+		}
+		
 		//Relinquishes ownership of the underlying buffer and resets this object
+		//(Buffers that were allocated by an allocator must be returned to it by the caller, using RasterAllocator::deallocate())
 		PrimitiveTy* releaseBuffer()
 		{
+			this->_allocator = nullptr;
 			this->_autoRelease = false;
 			this->_channels = 0;
 			this->_rows = 0;
@@ -115,11 +183,33 @@ class RasterData
 		
 	protected:
 		
+		//Frees the underlying buffer, returning it to its allocator if it has one
+		void freeBuffer()
+		{
+			//If we don't actually own the memory for the underlying buffer then relinquish it
+			//(Note: this unconventional behaviour was chosen to avoid introducing breaking API changes to mergetiff, which would
+			// have otherwise been necessary to accommodate variants of RasterData that use weak pointers / shared pointers / etc.)
+			if (this->_autoRelease == true) {
+				this->releaseBuffer();
+			}
+			else if (this->_allocator != nullptr)
+			{
+				RasterAllocator* allocator = this->_allocator;
+				uint64_t bytes = this->_channels * this->_rows * this->_cols * sizeof(PrimitiveTy);
+				allocator->deallocate(this->releaseBuffer(), bytes);
+			}
+			else {
+				MERGETIFF_SMART_POINTER_RESET(this->_data, nullptr);
+			}
+		}
+		
 		//Moves data from another object instance
 		void moveFrom(RasterData&& other)
 		{
 			this->_data = std::move(other._data);
+			this->_allocator = other._allocator;
 			this->_autoRelease = other._autoRelease;
+			this->_layout = other._layout;
 			this->_channels = other._channels;
 			this->_rows = other._rows;
 			this->_cols = other._cols;
@@ -128,11 +218,13 @@ class RasterData
 		
 		//Computes the array index for the specified channel of the specified pixel
 		uint64_t index(uint64_t y, uint64_t x, uint64_t channel) const {
-			return (y * this->_cols * this->_channels) + (x * this->_channels) + channel;
+			return (y * this->lineSpacing()) + (x * this->pixelSpacing()) + (channel * this->channelSpacing());
 		}
 		
 		MERGETIFF_SMART_POINTER_TYPE<PrimitiveTy[]> _data;
+		RasterAllocator* _allocator;
 		bool _autoRelease;
+		RasterLayout _layout;
 		uint64_t _channels;
 		uint64_t _rows;
 		uint64_t _cols;
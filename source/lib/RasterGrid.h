@@ -0,0 +1,226 @@
+#ifndef _MERGETIFF_RASTER_GRID
+#define _MERGETIFF_RASTER_GRID
+
+#include "ErrorHandling.h"
+#include "MergeOptions.h"
+#include "RasterWindow.h"
+
+#include <gdal.h>
+#include <gdal_priv.h>
+#include <ogr_spatialref.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace mergetiff {
+
+//Represents a north-up georeferenced pixel grid
+class RasterGrid
+{
+	public:
+		
+		RasterGrid() : width(0), height(0)
+		{
+			for (int index = 0; index < 6; ++index) {
+				this->geoTransform[index] = 0.0;
+			}
+		}
+		
+		//Retrieves the grid of the dataset that owns the specified raster band, returning false if it is not georeferenced or not north-up
+		static inline bool fromBand(GDALRasterBand* band, RasterGrid& grid)
+		{
+			GDALDataset* dataset = band->GetDataset();
+			if (dataset == nullptr || dataset->GetGeoTransform(grid.geoTransform) == CE_Failure) {
+				return false;
+			}
+			
+			grid.width = band->GetXSize();
+			grid.height = band->GetYSize();
+			return grid.geoTransform[2] == 0.0 && grid.geoTransform[4] == 0.0 && grid.geoTransform[1] > 0.0 && grid.geoTransform[5] < 0.0;
+		}
+		
+		//Determines if the datasets that own the specified raster bands use the same spatial reference system
+		//(Datasets without a spatial reference system only match other datasets without one)
+		static inline bool sameProjection(GDALRasterBand* first, GDALRasterBand* second)
+		{
+			std::string firstWkt = first->GetDataset()->GetProjectionRef();
+			std::string secondWkt = second->GetDataset()->GetProjectionRef();
+			if (firstWkt == secondWkt) {
+				return true;
+			}
+			
+			if (firstWkt.empty() || secondWkt.empty()) {
+				return false;
+			}
+			
+			//Equivalent systems can be described by different WKT strings (e.g. with or without authority codes)
+			OGRSpatialReference firstSrs;
+			OGRSpatialReference secondSrs;
+			return
+				firstSrs.SetFromUserInput(firstWkt.c_str()) == OGRERR_NONE &&
+				secondSrs.SetFromUserInput(secondWkt.c_str()) == OGRERR_NONE &&
+				firstSrs.IsSame(&secondSrs);
+		}
+		
+		//Computes the common target grid for the supplied raster bands, which all use the resolution of the first band
+		static inline RasterGrid forBands(const std::vector<GDALRasterBand*>& bands, GridAlignment alignment)
+		{
+			//Retrieve the grid for each of the bands
+			std::vector<RasterGrid> grids(bands.size());
+			for (size_t index = 0; index < bands.size(); ++index)
+			{
+				if (RasterGrid::fromBand(bands[index], grids[index]) == false) {
+					return ErrorHandling::handleError<RasterGrid>("grid alignment requires all raster bands to have a north-up geotransform");
+				}
+				
+				//The extents of the bands can only be compared if their coordinates are in the same spatial reference system
+				if (RasterGrid::sameProjection(bands[0], bands[index]) == false) {
+					return ErrorHandling::handleError<RasterGrid>("grid alignment requires all raster bands to have the same projection");
+				}
+			}
+			
+			//When using the grid of the first input, no further computation is required
+			const RasterGrid& first = grids[0];
+			if (alignment == GridAlignment::FirstInput) {
+				return first;
+			}
+			
+			//Compute the union or intersection of the band extents
+			double minX = first.minX();
+			double maxX = first.maxX();
+			double minY = first.minY();
+			double maxY = first.maxY();
+			for (auto& grid : grids)
+			{
+				if (alignment == GridAlignment::Union)
+				{
+					minX = std::min(minX, grid.minX());
+					maxX = std::max(maxX, grid.maxX());
+					minY = std::min(minY, grid.minY());
+					maxY = std::max(maxY, grid.maxY());
+				}
+				else
+				{
+					minX = std::max(minX, grid.minX());
+					maxX = std::min(maxX, grid.maxX());
+					minY = std::max(minY, grid.minY());
+					maxY = std::min(maxY, grid.maxY());
+				}
+			}
+			
+			if (minX >= maxX || minY >= maxY) {
+				return ErrorHandling::handleError<RasterGrid>("the extents of the supplied raster bands do not intersect");
+			}
+			
+			//Snap the extent outwards to the pixel grid of the first band (using a small tolerance to absorb rounding errors)
+			const double tolerance = 1e-6;
+			double resX = std::fabs(first.geoTransform[1]);
+			double resY = std::fabs(first.geoTransform[5]);
+			double originX = first.geoTransform[0];
+			double originY = first.geoTransform[3];
+			double left = originX + std::floor(((minX - originX) / resX) + tolerance) * resX;
+			double right = originX + std::ceil(((maxX - originX) / resX) - tolerance) * resX;
+			double bottom = originY + std::floor(((minY - originY) / resY) + tolerance) * resY;
+			double top = originY + std::ceil(((maxY - originY) / resY) - tolerance) * resY;
+			
+			//Build the north-up grid covering the snapped extent
+			RasterGrid result;
+			result.geoTransform[0] = left;
+			result.geoTransform[1] = resX;
+			result.geoTransform[3] = top;
+			result.geoTransform[5] = -resY;
+			result.width = (int)(std::floor(((right - left) / resX) + 0.5));
+			result.height = (int)(std::floor(((top - bottom) / resY) + 0.5));
+			return result;
+		}
+		
+		//Returns the extent of the grid in georeferenced coordinates
+		double minX() const { return std::min(this->geoTransform[0], this->geoTransform[0] + this->width * this->geoTransform[1]); }
+		double maxX() const { return std::max(this->geoTransform[0], this->geoTransform[0] + this->width * this->geoTransform[1]); }
+		double minY() const { return std::min(this->geoTransform[3], this->geoTransform[3] + this->height * this->geoTransform[5]); }
+		double maxY() const { return std::max(this->geoTransform[3], this->geoTransform[3] + this->height * this->geoTransform[5]); }
+		
+		//Determines if another grid has exactly the same origin, resolution and dimensions as this grid
+		bool matches(const RasterGrid& other) const
+		{
+			for (int index = 0; index < 6; ++index)
+			{
+				if (this->geoTransform[index] != other.geoTransform[index]) {
+					return false;
+				}
+			}
+			
+			return this->width == other.width && this->height == other.height;
+		}
+		
+		double geoTransform[6];
+		int width;
+		int height;
+};
+
+//Describes how a window of a target grid maps onto the pixels of a source grid
+class GridMapping
+{
+	public:
+		
+		GridMapping() : empty(true), sourceX(0.0), sourceY(0.0), sourceWidth(0.0), sourceHeight(0.0) {}
+		
+		//Maps a window of the target grid onto the source grid, clipping it to the pixels of the target window whose centres fall within the source
+		static inline GridMapping map(const RasterGrid& target, const RasterWindow& window, const RasterGrid& source)
+		{
+			//Compute the source pixel coordinates of the window's edges, and the size of a target pixel in source pixels
+			double x0 = ((target.geoTransform[0] + window.x * target.geoTransform[1]) - source.geoTransform[0]) / source.geoTransform[1];
+			double y0 = ((target.geoTransform[3] + window.y * target.geoTransform[5]) - source.geoTransform[3]) / source.geoTransform[5];
+			double stepX = target.geoTransform[1] / source.geoTransform[1];
+			double stepY = target.geoTransform[5] / source.geoTransform[5];
+			
+			//Determine the range of target pixels whose centres fall within the source raster
+			GridMapping mapping;
+			int firstX = std::max(0, (int)(std::ceil((0.0 - x0) / stepX - 0.5)));
+			int lastX = std::min(window.width - 1, (int)(std::ceil((source.width - x0) / stepX - 0.5)) - 1);
+			int firstY = std::max(0, (int)(std::ceil((0.0 - y0) / stepY - 0.5)));
+			int lastY = std::min(window.height - 1, (int)(std::ceil((source.height - y0) / stepY - 0.5)) - 1);
+			if (firstX > lastX || firstY > lastY) {
+				return mapping;
+			}
+			
+			//Compute the corresponding (fractional) source window
+			mapping.empty = false;
+			mapping.destination = RasterWindow(firstX, firstY, (lastX - firstX) + 1, (lastY - firstY) + 1);
+			mapping.sourceX = std::max(0.0, x0 + firstX * stepX);
+			mapping.sourceY = std::max(0.0, y0 + firstY * stepY);
+			mapping.sourceWidth = std::min((double)(source.width), x0 + (lastX + 1) * stepX) - mapping.sourceX;
+			mapping.sourceHeight = std::min((double)(source.height), y0 + (lastY + 1) * stepY) - mapping.sourceY;
+			return mapping;
+		}
+		
+		//Returns the smallest integer source window containing the fractional source window
+		RasterWindow sourceWindow() const
+		{
+			int x = (int)(std::floor(this->sourceX));
+			int y = (int)(std::floor(this->sourceY));
+			return RasterWindow(
+				x,
+				y,
+				std::max(1, (int)(std::ceil(this->sourceX + this->sourceWidth - 1e-9)) - x),
+				std::max(1, (int)(std::ceil(this->sourceY + this->sourceHeight - 1e-9)) - y)
+			);
+		}
+		
+		//Indicates that no pixels of the target window fall within the source raster
+		bool empty;
+		
+		//The region of the target window that is covered by the source raster, relative to the window's origin
+		RasterWindow destination;
+		
+		//The fractional source window corresponding to the covered region
+		double sourceX;
+		double sourceY;
+		double sourceWidth;
+		double sourceHeight;
+};
+
+} //End namespace mergetiff
+
+#endif
@@ -1,14 +1,22 @@
 #ifndef _MERGETIFF_RASTER_IO
 #define _MERGETIFF_RASTER_IO
 
+#include "BandReaderPool.h"
+#include "BandStatistics.h"
+#include "ChannelInterleaving.h"
 #include "DatatypeConversion.h"
 #include "ErrorHandling.h"
 #include "RasterData.h"
+#include "RasterView.h"
+#include "RasterWindow.h"
 #include "SmartPointers.h"
+#include "ThreadPool.h"
 
 #include <gdal_priv.h>
 #include <gdal.h>
 #include <algorithm>
+#include <future>
+#include <string>
 #include <vector>
 
 namespace mergetiff {
@@ -17,9 +25,13 @@ class RasterIO
 {
 	public:
 		
-		//Reads the raster data for an entire dataset
+		//Reads the raster data for an entire dataset, storing the channels in the specified layout
+		//(If more than one thread is requested then the bands are read concurrently, see readBands() for details. Zero selects the number of hardware threads.
+		// If an allocator is supplied then the buffer is allocated by it, so a RasterBufferPool can recycle the buffers of rasters with the same shape.
+		// Planar buffers are filled by contiguous reads of each band, rather than the strided reads required to interleave the channels.
+		// If a statistics vector is supplied then it is filled with the statistics of each channel, computed from the buffer rather than by reading the bands again.)
 		template <typename PrimitiveTy>
-		static inline RasterData<PrimitiveTy> readDataset(GDALDatasetRef& dataset, GDALDataType expectedType, std::vector<unsigned int> bands = std::vector<unsigned int>())
+		static inline RasterData<PrimitiveTy> readDataset(GDALDatasetRef& dataset, GDALDataType expectedType, std::vector<unsigned int> bands = std::vector<unsigned int>(), unsigned int numThreads = 1, RasterAllocator* allocator = nullptr, RasterLayout layout = RasterLayout::Interleaved, std::vector<BandStatistics>* statistics = nullptr)
 		{
 			//Verify that a valid dataset was supplied
 			if (!dataset || dataset->GetRasterCount() < 1) {
@@ -54,27 +66,53 @@ class RasterIO
 			uint64_t numCols = dataset->GetRasterXSize();
 			
 			//Create the buffer to hold the raster data
-			RasterData<PrimitiveTy> data(numChannels, numRows, numCols);
+			RasterData<PrimitiveTy> data(numChannels, numRows, numCols, allocator, layout);
+			if (!data) {
+				return ErrorHandling::handleError< RasterData<PrimitiveTy> >("failed to allocate a buffer for the raster data");
+			}
 			
-			//Read the data one raster band at a time
-			unsigned int channelOffset = 0;
-			for (auto bandIndex : bands)
-			{
-				//Retrieve the raster band for this channel
-				GDALRasterBand* band = dataset->GetRasterBand(bandIndex);
-				
-				//Read the raster data into our buffer
-				if (RasterIO::bandToBuffer<PrimitiveTy>(band, data, numChannels, numCols, numRows, channelOffset++) == false) {
-					return ErrorHandling::handleError< RasterData<PrimitiveTy> >("failed to read data from GDAL raster band");
-				}
+			//Read the raster data into our buffer
+			if (RasterIO::readBands<PrimitiveTy>(dataset, data, bands, 0, numThreads) == false) {
+				return ErrorHandling::handleError< RasterData<PrimitiveTy> >("failed to read data from GDAL raster band");
+			}
+			
+			//Compute the statistics of each channel if requested
+			if (statistics != nullptr) {
+				*statistics = RasterIO::computeStatistics<PrimitiveTy>(dataset, data, bands, numThreads);
 			}
 			
 			return data;
 		}
 		
+		//Computes the statistics of each channel of an in-memory buffer that was read from the specified bands of a dataset,
+		//excluding pixels that contain each band's "no data" value (the channels are processed concurrently if more than one thread is requested)
+		template <typename PrimitiveTy>
+		static inline std::vector<BandStatistics> computeStatistics(GDALDatasetRef& dataset, RasterData<PrimitiveTy>& data, const std::vector<unsigned int>& bands, unsigned int numThreads = 1)
+		{
+			std::vector<BandStatistics> statistics(bands.size());
+			ThreadPool pool(std::max<unsigned int>(1, std::min<unsigned int>(ThreadPool::resolveThreadCount(numThreads), (unsigned int)(bands.size()))));
+			std::vector< std::future<void> > pending;
+			RasterView<PrimitiveTy> view(data);
+			for (size_t index = 0; index < bands.size() && index < data.channels(); ++index)
+			{
+				int hasNoData = 0;
+				double noDataValue = dataset->GetRasterBand(bands[index])->GetNoDataValue(&hasNoData);
+				pending.push_back(pool.submit([&statistics, view, index, hasNoData, noDataValue]() {
+					statistics[index] = BandStatisticsAccumulator<PrimitiveTy>::compute(view, index, hasNoData, noDataValue);
+				}));
+			}
+			
+			for (auto& result : pending) {
+				result.wait();
+			}
+			
+			return statistics;
+		}
+		
 		//Reads the raster data for an entire dataset into an existing in-memory buffer
+		//(If more than one thread is requested then the bands are read concurrently, see readBands() for details. Zero selects the number of hardware threads)
 		template <typename PrimitiveTy>
-		static inline bool readDataset(GDALDatasetRef& dataset, RasterData<PrimitiveTy>& data, std::vector<unsigned int> bands = std::vector<unsigned int>(), unsigned int destOffset = 0)
+		static inline bool readDataset(GDALDatasetRef& dataset, RasterData<PrimitiveTy>& data, std::vector<unsigned int> bands = std::vector<unsigned int>(), unsigned int destOffset = 0, unsigned int numThreads = 1)
 		{
 			//Verify that a valid dataset was supplied
 			if (!dataset || dataset->GetRasterCount() < 1) {
@@ -115,22 +153,26 @@ class RasterIO
 				return ErrorHandling::handleError<bool>("dataset raster dimensions do not match supplied buffer dimensions");
 			}
 			
-			//Read the data one raster band at a time
-			unsigned int channelOffset = destOffset;
-			for (auto bandIndex : bands)
-			{
-				//Retrieve the raster band for this channel
-				GDALRasterBand* band = dataset->GetRasterBand(bandIndex);
-				
-				//Read the raster data into our buffer
-				if (RasterIO::bandToBuffer<PrimitiveTy>(band, data, data.channels(), numCols, numRows, channelOffset++) == false) {
-					return ErrorHandling::handleError<bool>("failed to read data from GDAL raster band");
-				}
+			//Read the raster data into our buffer
+			if (RasterIO::readBands<PrimitiveTy>(dataset, data, bands, destOffset, numThreads) == false) {
+				return ErrorHandling::handleError<bool>("failed to read data from GDAL raster band");
 			}
 			
 			return data;
 		}
 		
+		//Reads the raster data for an entire dataset into a view of an existing buffer whose dimensions match the dataset
+		template <typename PrimitiveTy>
+		static inline bool readDataset(GDALDatasetRef& dataset, const RasterView<PrimitiveTy>& view, std::vector<unsigned int> bands = std::vector<unsigned int>())
+		{
+			//Verify that a valid dataset was supplied
+			if (!dataset || dataset->GetRasterCount() < 1) {
+				return ErrorHandling::handleError<bool>("supplied dataset does not contain any raster bands");
+			}
+			
+			return RasterIO::readWindow<PrimitiveTy>(dataset, view, RasterWindow(0, 0, dataset->GetRasterXSize(), dataset->GetRasterYSize()), bands);
+		}
+		
 		//Reads the raster data for an individual raster band
 		template <typename PrimitiveTy>
 		static inline RasterData<PrimitiveTy> readBand(GDALRasterBand* band, GDALDataType expectedType)
@@ -157,8 +199,9 @@ class RasterIO
 		}
 		
 		//Reads the raster data for an individual raster band into an existing in-memory buffer, with an optional destination channel offset
+		//(If more than one thread is requested then strips of rows are read concurrently, see readBands() for details. Zero selects the number of hardware threads)
 		template <typename PrimitiveTy>
-		static inline bool readBandWithOffset(GDALDatasetRef& dataset, RasterData<PrimitiveTy>& data, unsigned int bandIndex, unsigned int destOffset = 0)
+		static inline bool readBandWithOffset(GDALDatasetRef& dataset, RasterData<PrimitiveTy>& data, unsigned int bandIndex, unsigned int destOffset = 0, unsigned int numThreads = 1)
 		{
 			//Verify that a valid dataset was supplied
 			if (!dataset || dataset->GetRasterCount() < 1) {
@@ -182,7 +225,6 @@ class RasterIO
 			}
 			
 			//Determine the image dimensions
-			uint64_t numChannels = data.channels();
 			uint64_t numRows = dataset->GetRasterYSize();
 			uint64_t numCols = dataset->GetRasterXSize();
 			
@@ -191,14 +233,411 @@ class RasterIO
 				return ErrorHandling::handleError<bool>("cannot copy raster data into buffer with different image dimensions");
 			}
 			
-			//Retrieve the requested raster band
-			GDALRasterBand* band = dataset->GetRasterBand(bandIndex);
-			
 			//Read the raster data into the buffer
-			return RasterIO::bandToBuffer<PrimitiveTy>(band, data, numChannels, numCols, numRows, destOffset);
+			return RasterIO::readBands<PrimitiveTy>(dataset, data, std::vector<unsigned int>({bandIndex}), destOffset, numThreads);
+		}
+		
+		//Reads the specified raster bands of a dataset into consecutive channels of an existing buffer with matching dimensions, starting at the specified channel
+		//(When more than one thread is used, the bands are divided into strips of rows aligned to the dataset's blocks, and the strips of every band are
+		// read concurrently by a pool of worker threads, each of which reopens the dataset to obtain its own GDAL handle and writes directly into the buffer.
+		// Datasets that cannot be reopened, such as in-memory datasets, are read through the supplied handle one strip at a time.
+		// When the dataset is pixel-interleaved, all of the bands in each strip are read by a single dataset-level read, so that each block is only decoded once.)
+		template <typename PrimitiveTy>
+		static inline bool readBands(GDALDatasetRef& dataset, RasterData<PrimitiveTy>& data, const std::vector<unsigned int>& bands, unsigned int channelOffset = 0, unsigned int numThreads = 1)
+		{
+			uint64_t numRows = data.rows();
+			uint64_t numCols = data.cols();
+			
+			//Read the data on the calling thread unless multiple threads were requested (all of the bands at once if they share their blocks)
+			bool interleaved = (bands.size() > 1 && RasterIO::isPixelInterleaved(MERGETIFF_SMART_POINTER_GET(dataset)));
+			numThreads = ThreadPool::resolveThreadCount(numThreads);
+			if (numThreads == 1 && interleaved == true) {
+				return RasterIO::datasetToBuffer<PrimitiveTy>(MERGETIFF_SMART_POINTER_GET(dataset), data, bands, RasterWindow(0, 0, (int)(numCols), (int)(numRows)), channelOffset);
+			}
+			
+			//Retrieve the raster bands to be read
+			std::vector<GDALRasterBand*> rasterBands;
+			for (auto bandIndex : bands) {
+				rasterBands.push_back(dataset->GetRasterBand(bandIndex));
+			}
+			
+			//(Single-threaded reads of interleaved buffers interleave the bands themselves, see bandsToBuffer() for details)
+			if (numThreads == 1 || bands.empty()) {
+				return RasterIO::bandsToBuffer<PrimitiveTy>(rasterBands, data, RasterWindow(0, 0, (int)(numCols), (int)(numRows)), channelOffset);
+			}
+			
+			//Divide each band into enough strips to give every thread at least two chunks to read, rounding the strip height up to a whole number of blocks
+			//(Pixel-interleaved strips are read for all of the bands at once, so each strip is a single chunk)
+			int blockWidth = 0;
+			int blockHeight = 0;
+			rasterBands[0]->GetBlockSize(&blockWidth, &blockHeight);
+			uint64_t chunksPerStrip = interleaved ? 1 : bands.size();
+			uint64_t stripsPerBand = std::max<uint64_t>(1, ((numThreads * 2) + chunksPerStrip - 1) / chunksPerStrip);
+			uint64_t stripRows = (numRows + stripsPerBand - 1) / stripsPerBand;
+			uint64_t blockRows = std::max<uint64_t>(1, blockHeight);
+			stripRows = std::max<uint64_t>(blockRows, ((stripRows + blockRows - 1) / blockRows) * blockRows);
+			
+			//Read each strip of each band on the worker threads, or each strip of all bands at once if the bands share their blocks
+			GDALDataType dtype = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
+			GSpacing pixelSpace = sizeof(PrimitiveTy) * data.pixelSpacing();
+			GSpacing lineSpace = sizeof(PrimitiveTy) * data.lineSpacing();
+			GSpacing bandSpace = sizeof(PrimitiveTy) * data.channelSpacing();
+			BandReaderPool readers(rasterBands, numThreads);
+			ThreadPool pool(numThreads);
+			std::vector< std::future<bool> > reads;
+			if (interleaved == true)
+			{
+				for (uint64_t row = 0; row < numRows; row += stripRows)
+				{
+					uint64_t rows = std::min(stripRows, numRows - row);
+					PrimitiveTy* buffer = data.getBuffer() + (row * data.lineSpacing()) + (channelOffset * data.channelSpacing());
+					reads.push_back(pool.submit([&readers, &dtype, row, rows, numCols, pixelSpace, lineSpace, bandSpace, buffer]() -> bool
+					{
+						BandReaderPool::Context* context = readers.acquire();
+						bool success = readers.readAllBands(
+							context,
+							0,
+							(int)(row),
+							(int)(numCols),
+							(int)(rows),
+							buffer,
+							dtype,
+							pixelSpace,
+							lineSpace,
+							bandSpace
+						);
+						
+						readers.release(context);
+						return success;
+					}));
+				}
+			}
+			
+			for (size_t index = 0; index < rasterBands.size() && interleaved == false; ++index)
+			{
+				for (uint64_t row = 0; row < numRows; row += stripRows)
+				{
+					uint64_t rows = std::min(stripRows, numRows - row);
+					PrimitiveTy* buffer = data.getBuffer() + (row * data.lineSpacing()) + ((channelOffset + index) * data.channelSpacing());
+					reads.push_back(pool.submit([&readers, &dtype, index, row, rows, numCols, pixelSpace, lineSpace, buffer]() -> bool
+					{
+						BandReaderPool::Context* context = readers.acquire();
+						bool success = readers.read(
+							context,
+							index,
+							0,
+							(int)(row),
+							(int)(numCols),
+							(int)(rows),
+							buffer,
+							(int)(numCols),
+							(int)(rows),
+							dtype,
+							pixelSpace,
+							lineSpace
+						);
+						
+						readers.release(context);
+						return success;
+					}));
+				}
+			}
+			
+			//Wait for all of the reads to complete, since they write directly into the buffer
+			bool success = true;
+			for (auto& read : reads) {
+				success = read.get() && success;
+			}
+			
+			return success;
+		}
+		
+		//Reads the raster data for a window of a dataset, without reading any of the data outside the window
+		template <typename PrimitiveTy>
+		static inline RasterData<PrimitiveTy> readWindow(GDALDatasetRef& dataset, GDALDataType expectedType, const RasterWindow& window, std::vector<unsigned int> bands = std::vector<unsigned int>(), RasterLayout layout = RasterLayout::Interleaved)
+		{
+			//Verify that a valid dataset was supplied
+			if (!dataset || dataset->GetRasterCount() < 1) {
+				return ErrorHandling::handleError< RasterData<PrimitiveTy> >("supplied dataset does not contain any raster bands");
+			}
+			
+			//Verify that the dataset datatype matches the expected datatype
+			if (dataset->GetRasterBand(1)->GetRasterDataType() != expectedType) {
+				return ErrorHandling::handleError< RasterData<PrimitiveTy> >("supplied dataset datatype does not match expected datatype");
+			}
+			
+			//Fill the band list with the indices of all bands present in the dataset if none were specified
+			if (bands.empty())
+			{
+				for (unsigned int index = 1; index <= (unsigned int)(dataset->GetRasterCount()); ++index) {
+					bands.push_back(index);
+				}
+			}
+			
+			//Create the buffer to hold the raster data and read the window into it
+			RasterData<PrimitiveTy> data(bands.size(), (window.height > 0) ? window.height : 0, (window.width > 0) ? window.width : 0, layout);
+			if (RasterIO::readWindow<PrimitiveTy>(dataset, data, window, bands) == false) {
+				return RasterData<PrimitiveTy>();
+			}
+			
+			return data;
+		}
+		
+		//Reads the raster data for a window of a dataset into an existing in-memory buffer whose dimensions match the window
+		template <typename PrimitiveTy>
+		static inline bool readWindow(GDALDatasetRef& dataset, RasterData<PrimitiveTy>& data, const RasterWindow& window, std::vector<unsigned int> bands = std::vector<unsigned int>(), unsigned int destOffset = 0)
+		{
+			//Verify that a valid dataset was supplied
+			if (!dataset || dataset->GetRasterCount() < 1) {
+				return ErrorHandling::handleError<bool>("supplied dataset does not contain any raster bands");
+			}
+			
+			//Verify that the dataset datatype matches the expected datatype
+			GDALDataType expectedType = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
+			if (dataset->GetRasterBand(1)->GetRasterDataType() != expectedType) {
+				return ErrorHandling::handleError<bool>("supplied dataset datatype does not match expected datatype");
+			}
+			
+			//Verify that the window lies within the dataset
+			if (window.within(dataset->GetRasterXSize(), dataset->GetRasterYSize()) == false) {
+				return ErrorHandling::handleError<bool>("window does not lie within the dataset's raster dimensions");
+			}
+			
+			//Determine if a set of band indices were specified
+			if (!bands.empty())
+			{
+				//Verify that all of the requested band indices are valid
+				unsigned int maxBand = *(std::max_element(bands.begin(), bands.end()));
+				if (maxBand > (unsigned int)(dataset->GetRasterCount())) {
+					return ErrorHandling::handleError<bool>("invalid band index " + std::to_string(maxBand));
+				}
+			}
+			else
+			{
+				//Fill the vector with the indices of all bands present in the dataset
+				for (unsigned int index = 1; index <= (unsigned int)(dataset->GetRasterCount()); ++index) {
+					bands.push_back(index);
+				}
+			}
+			
+			//Verify that the buffer dimensions match the window dimensions
+			if (destOffset + bands.size() > data.channels() || (uint64_t)(window.height) != data.rows() || (uint64_t)(window.width) != data.cols()) {
+				return ErrorHandling::handleError<bool>("window dimensions do not match supplied buffer dimensions");
+			}
+			
+			//Read all of the bands at once if they share their blocks, or one band at a time otherwise
+			bool success = true;
+			if (bands.size() > 1 && RasterIO::isPixelInterleaved(MERGETIFF_SMART_POINTER_GET(dataset))) {
+				success = RasterIO::datasetToBuffer<PrimitiveTy>(MERGETIFF_SMART_POINTER_GET(dataset), data, bands, window, destOffset);
+			}
+			else
+			{
+				std::vector<GDALRasterBand*> rasterBands;
+				for (auto bandIndex : bands) {
+					rasterBands.push_back(dataset->GetRasterBand(bandIndex));
+				}
+				
+				success = RasterIO::bandsToBuffer<PrimitiveTy>(rasterBands, data, window, destOffset);
+			}
+			
+			if (success == false) {
+				return ErrorHandling::handleError<bool>("failed to read data from GDAL raster band");
+			}
+			
+			return true;
+		}
+		
+		//Reads the raster data for a window of a dataset into a view of an existing buffer whose dimensions match the window, such as a region of a larger buffer
+		//(The data is read directly through the view's spacing, so no intermediate buffer or copy is required)
+		template <typename PrimitiveTy>
+		static inline bool readWindow(GDALDatasetRef& dataset, const RasterView<PrimitiveTy>& view, const RasterWindow& window, std::vector<unsigned int> bands = std::vector<unsigned int>())
+		{
+			//Verify that a valid dataset was supplied
+			if (!dataset || dataset->GetRasterCount() < 1) {
+				return ErrorHandling::handleError<bool>("supplied dataset does not contain any raster bands");
+			}
+			
+			//Verify that the dataset datatype matches the expected datatype
+			GDALDataType expectedType = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
+			if (dataset->GetRasterBand(1)->GetRasterDataType() != expectedType) {
+				return ErrorHandling::handleError<bool>("supplied dataset datatype does not match expected datatype");
+			}
+			
+			//Verify that the window lies within the dataset
+			if (window.within(dataset->GetRasterXSize(), dataset->GetRasterYSize()) == false) {
+				return ErrorHandling::handleError<bool>("window does not lie within the dataset's raster dimensions");
+			}
+			
+			//Determine if a set of band indices were specified
+			if (!bands.empty())
+			{
+				//Verify that all of the requested band indices are valid
+				unsigned int maxBand = *(std::max_element(bands.begin(), bands.end()));
+				if (maxBand > (unsigned int)(dataset->GetRasterCount())) {
+					return ErrorHandling::handleError<bool>("invalid band index " + std::to_string(maxBand));
+				}
+			}
+			else
+			{
+				//Fill the vector with the indices of all bands present in the dataset
+				for (unsigned int index = 1; index <= (unsigned int)(dataset->GetRasterCount()); ++index) {
+					bands.push_back(index);
+				}
+			}
+			
+			//Verify that the view dimensions match the window dimensions
+			if (!view || bands.size() != view.channels() || (uint64_t)(window.height) != view.rows() || (uint64_t)(window.width) != view.cols()) {
+				return ErrorHandling::handleError<bool>("window dimensions do not match supplied view dimensions");
+			}
+			
+			if (RasterIO::datasetToView<PrimitiveTy>(MERGETIFF_SMART_POINTER_GET(dataset), view, bands, window) == false) {
+				return ErrorHandling::handleError<bool>("failed to read data from GDAL raster band");
+			}
+			
+			return true;
+		}
+		
+		//Reads the raster data for a window of an individual raster band
+		template <typename PrimitiveTy>
+		static inline RasterData<PrimitiveTy> readBandWindow(GDALRasterBand* band, GDALDataType expectedType, const RasterWindow& window)
+		{
+			//Verify that the band datatype matches the expected datatype
+			if (band->GetRasterDataType() != expectedType) {
+				return ErrorHandling::handleError< RasterData<PrimitiveTy> >("supplied raster band datatype does not match expected datatype");
+			}
+			
+			//Verify that the window lies within the band
+			if (window.within(band->GetXSize(), band->GetYSize()) == false) {
+				return ErrorHandling::handleError< RasterData<PrimitiveTy> >("window does not lie within the raster band's dimensions");
+			}
+			
+			//Create the buffer to hold the raster data and read the window into it
+			RasterData<PrimitiveTy> data(1, window.height, window.width);
+			if (RasterIO::windowToBuffer<PrimitiveTy>(band, data, window) == false) {
+				return ErrorHandling::handleError< RasterData<PrimitiveTy> >("failed to read data from GDAL raster band");
+			}
+			
+			return data;
+		}
+		
+		//Reads a dataset at a reduced size, such as for a thumbnail or preview, reading from the smallest overview level that is at least as large as
+		//the requested size and resampling it to that size (bands without suitable overviews are resampled from the full-resolution data by GDAL)
+		template <typename PrimitiveTy>
+		static inline RasterData<PrimitiveTy> readPreview(GDALDatasetRef& dataset, GDALDataType expectedType, int width, int height, GDALRIOResampleAlg resampling = GRIORA_Average, std::vector<unsigned int> bands = std::vector<unsigned int>(), RasterLayout layout = RasterLayout::Interleaved)
+		{
+			//Verify that a valid dataset was supplied
+			if (!dataset || dataset->GetRasterCount() < 1) {
+				return ErrorHandling::handleError< RasterData<PrimitiveTy> >("supplied dataset does not contain any raster bands");
+			}
+			
+			//Verify that the dataset datatype matches the expected datatype
+			if (dataset->GetRasterBand(1)->GetRasterDataType() != expectedType) {
+				return ErrorHandling::handleError< RasterData<PrimitiveTy> >("supplied dataset datatype does not match expected datatype");
+			}
+			
+			//Verify that the requested size is valid
+			if (width < 1 || height < 1) {
+				return ErrorHandling::handleError< RasterData<PrimitiveTy> >("invalid preview size " + std::to_string(width) + "x" + std::to_string(height));
+			}
+			
+			//Determine if a set of band indices were specified
+			if (!bands.empty())
+			{
+				//Verify that all of the requested band indices are valid
+				unsigned int maxBand = *(std::max_element(bands.begin(), bands.end()));
+				if (maxBand > (unsigned int)(dataset->GetRasterCount())) {
+					return ErrorHandling::handleError< RasterData<PrimitiveTy> >("invalid band index " + std::to_string(maxBand));
+				}
+			}
+			else
+			{
+				//Fill the vector with the indices of all bands present in the dataset
+				for (unsigned int index = 1; index <= (unsigned int)(dataset->GetRasterCount()); ++index) {
+					bands.push_back(index);
+				}
+			}
+			
+			//Create the buffer to hold the reduced raster data
+			uint64_t numChannels = bands.size();
+			RasterData<PrimitiveTy> data(numChannels, height, width, layout);
+			
+			//Read each band from its best overview level, resampling the whole extent of the level to the requested size
+			GDALDataType dtype = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
+			GDALRasterIOExtraArg extraArg;
+			INIT_RASTERIO_EXTRA_ARG(extraArg);
+			extraArg.eResampleAlg = resampling;
+			for (uint64_t channel = 0; channel < numChannels; ++channel)
+			{
+				GDALRasterBand* band = RasterIO::bestOverview(dataset->GetRasterBand(bands[channel]), width, height);
+				CPLErr result = band->RasterIO(
+					GF_Read,
+					0,
+					0,
+					band->GetXSize(),
+					band->GetYSize(),
+					data.getBuffer() + (channel * data.channelSpacing()),
+					width,
+					height,
+					dtype,
+					sizeof(PrimitiveTy) * data.pixelSpacing(),
+					sizeof(PrimitiveTy) * data.lineSpacing(),
+					&extraArg
+				);
+				
+				if (result == CE_Failure) {
+					return ErrorHandling::handleError< RasterData<PrimitiveTy> >("failed to read data from GDAL raster band");
+				}
+			}
+			
+			return data;
+		}
+		
+		//Reads a dataset at a reduced size whose largest dimension is the specified number of pixels, preserving its aspect ratio (see readPreview())
+		template <typename PrimitiveTy>
+		static inline RasterData<PrimitiveTy> readThumbnail(GDALDatasetRef& dataset, GDALDataType expectedType, int maxDimension, GDALRIOResampleAlg resampling = GRIORA_Average, std::vector<unsigned int> bands = std::vector<unsigned int>(), RasterLayout layout = RasterLayout::Interleaved)
+		{
+			//Verify that a valid dataset was supplied
+			if (!dataset || dataset->GetRasterCount() < 1) {
+				return ErrorHandling::handleError< RasterData<PrimitiveTy> >("supplied dataset does not contain any raster bands");
+			}
+			
+			//Scale the larger dimension to the requested size, rounding the smaller dimension to the nearest pixel
+			double scale = (double)(maxDimension) / (double)(std::max(dataset->GetRasterXSize(), dataset->GetRasterYSize()));
+			int width = std::max(1, (int)(dataset->GetRasterXSize() * scale + 0.5));
+			int height = std::max(1, (int)(dataset->GetRasterYSize() * scale + 0.5));
+			return RasterIO::readPreview<PrimitiveTy>(dataset, expectedType, width, height, resampling, bands, layout);
+		}
+		
+		//Returns the smallest overview level of a raster band that is at least as large as the specified size in both dimensions,
+		//or the band itself if it has no such overview level
+		static inline GDALRasterBand* bestOverview(GDALRasterBand* band, int width, int height)
+		{
+			GDALRasterBand* best = band;
+			for (int index = 0; index < band->GetOverviewCount(); ++index)
+			{
+				GDALRasterBand* overview = band->GetOverview(index);
+				if (overview != nullptr && overview->GetXSize() >= width && overview->GetYSize() >= height && overview->GetXSize() < best->GetXSize()) {
+					best = overview;
+				}
+			}
+			
+			return best;
+		}
+		
+		//Returns the grid of native blocks for a raster band, whose tile dimensions are the band's block size
+		//(Reading or writing the windows of this grid in turn walks the band one block at a time, without ever decoding a block twice)
+		static inline TileGrid nativeBlockGrid(GDALRasterBand* band)
+		{
+			int blockWidth = 0;
+			int blockHeight = 0;
+			band->GetBlockSize(&blockWidth, &blockHeight);
+			return TileGrid(band->GetXSize(), band->GetYSize(), std::max(1, blockWidth), std::max(1, blockHeight));
 		}
 		
 		//Writes the raster data for an entire dataset
+		//(The data is written in strips of whole blocks, with all of the bands in each strip written by a single call, so every block is complete
+		// when it is first written and never needs to be read back from the file. Each strip is flushed once it has been written, which allows
+		// drivers that compress with multiple worker threads, such as the GeoTiff driver's NUM_THREADS option, to compress its blocks in parallel.)
 		template <typename PrimitiveTy>
 		static inline bool writeDataset(GDALDatasetRef& dataset, const RasterData<PrimitiveTy>& data)
 		{
@@ -223,21 +662,38 @@ class RasterIO
 				return false;
 			}
 			
-			//Write the data one channel at a time
-			for (int channel = 0; channel < numChannels; ++channel)
+			//Use strips that contain at least a million pixels, to avoid excessive overheads for datasets whose blocks are a single row (such as in-memory datasets)
+			TileGrid blocks = RasterIO::nativeBlockGrid(dataset->GetRasterBand(1));
+			uint64_t blockRows = blocks.tileHeight;
+			uint64_t minimumRows = ((1 << 20) + numCols - 1) / numCols;
+			uint64_t stripRows = ((std::max(minimumRows, blockRows) + blockRows - 1) / blockRows) * blockRows;
+			
+			//Write the data one strip at a time
+			for (uint64_t row = 0; row < numRows; row += stripRows)
 			{
-				//Retrieve the raster band for this channel
-				GDALRasterBand* band = dataset->GetRasterBand(channel + 1);
-				
-				//Write the raster data from our buffer
-				if (RasterIO::bufferToBand<PrimitiveTy>(band, data, numChannels, numCols, numRows, channel) == false) {
+				uint64_t rows = std::min(stripRows, numRows - row);
+				if (RasterIO::bufferToDataset<PrimitiveTy>(MERGETIFF_SMART_POINTER_GET(dataset), data, RasterWindow(0, (int)(row), (int)(numCols), (int)(rows)), row) == false) {
 					return false;
 				}
+				
+				dataset->FlushCache();
 			}
 			
 			return true;
 		}
 		
+		//Writes the raster data for an entire dataset from a view of a buffer whose dimensions match the dataset
+		template <typename PrimitiveTy>
+		static inline bool writeDataset(GDALDatasetRef& dataset, const RasterView<PrimitiveTy>& view)
+		{
+			//If an invalid dataset was supplied, signal failure
+			if (!dataset || dataset->GetRasterCount() < 1) {
+				return false;
+			}
+			
+			return RasterIO::writeWindow<PrimitiveTy>(dataset, view, RasterWindow(0, 0, dataset->GetRasterXSize(), dataset->GetRasterYSize()));
+		}
+		
 		//Writes the raster data for an individual raster band
 		template <typename PrimitiveTy>
 		static inline bool writeBand(GDALRasterBand* band, const RasterData<PrimitiveTy>& data)
@@ -262,45 +718,344 @@ class RasterIO
 			return RasterIO::bufferToBand<PrimitiveTy>(band, data, numChannels, numCols, numRows);
 		}
 		
+		//Writes raster data to a window of a dataset, with one channel for each of the dataset's raster bands
+		template <typename PrimitiveTy>
+		static inline bool writeWindow(GDALDatasetRef& dataset, const RasterData<PrimitiveTy>& data, const RasterWindow& window)
+		{
+			//If an invalid dataset was supplied, signal failure
+			if (!dataset || dataset->GetRasterCount() < 1) {
+				return false;
+			}
+			
+			//If the dataset datatype does not match the expected datatype, signal failure
+			GDALDataType expectedType = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
+			if (dataset->GetRasterBand(1)->GetRasterDataType() != expectedType) {
+				return false;
+			}
+			
+			//If the window does not lie within the dataset, signal failure
+			if (window.within(dataset->GetRasterXSize(), dataset->GetRasterYSize()) == false) {
+				return false;
+			}
+			
+			//If the window dimensions do not match the dimensions of the supplied raster data, signal failure
+			uint64_t numChannels = dataset->GetRasterCount();
+			if (numChannels != data.channels() || (uint64_t)(window.height) != data.rows() || (uint64_t)(window.width) != data.cols()) {
+				return false;
+			}
+			
+			//Write all of the channels at once
+			return RasterIO::bufferToDataset<PrimitiveTy>(MERGETIFF_SMART_POINTER_GET(dataset), data, window);
+		}
+		
+		//Writes a view of raster data to a window of a dataset, with one channel for each of the dataset's raster bands
+		//(The data is written directly through the view's spacing, so a region of a larger buffer can be written without copying it first)
+		template <typename PrimitiveTy>
+		static inline bool writeWindow(GDALDatasetRef& dataset, const RasterView<PrimitiveTy>& view, const RasterWindow& window)
+		{
+			//If an invalid dataset was supplied, signal failure
+			if (!dataset || dataset->GetRasterCount() < 1) {
+				return false;
+			}
+			
+			//If the dataset datatype does not match the expected datatype, signal failure
+			GDALDataType expectedType = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
+			if (dataset->GetRasterBand(1)->GetRasterDataType() != expectedType) {
+				return false;
+			}
+			
+			//If the window does not lie within the dataset, signal failure
+			if (window.within(dataset->GetRasterXSize(), dataset->GetRasterYSize()) == false) {
+				return false;
+			}
+			
+			//If the window dimensions do not match the dimensions of the supplied view, signal failure
+			if (!view || (uint64_t)(dataset->GetRasterCount()) != view.channels() || (uint64_t)(window.height) != view.rows() || (uint64_t)(window.width) != view.cols()) {
+				return false;
+			}
+			
+			return RasterIO::viewToDataset<PrimitiveTy>(MERGETIFF_SMART_POINTER_GET(dataset), view, window);
+		}
+		
+		//Writes single-channel raster data to a window of an individual raster band
+		template <typename PrimitiveTy>
+		static inline bool writeBandWindow(GDALRasterBand* band, const RasterData<PrimitiveTy>& data, const RasterWindow& window)
+		{
+			//If the dataset datatype does not match the expected datatype, signal failure
+			GDALDataType expectedType = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
+			if (band->GetRasterDataType() != expectedType) {
+				return false;
+			}
+			
+			//If the window does not lie within the band, signal failure
+			if (window.within(band->GetXSize(), band->GetYSize()) == false) {
+				return false;
+			}
+			
+			//If the window dimensions do not match the dimensions of the supplied raster data, signal failure
+			if (data.channels() != 1 || (uint64_t)(window.height) != data.rows() || (uint64_t)(window.width) != data.cols()) {
+				return false;
+			}
+			
+			return RasterIO::bufferToWindow<PrimitiveTy>(band, data, window);
+		}
+		
 		//Performs the GDALRasterBand::RasterIO() call to read data from the band into an in-memory buffer
+		//(The spacing of the buffer is determined by its layout, so numChannels is only retained for compatibility, and the read fails if it does not
+		// match the buffer's channel count or if the dimensions do not match those of the buffer)
 		template <typename PrimitiveTy>
 		static inline bool bandToBuffer(GDALRasterBand* band, RasterData<PrimitiveTy>& data, uint64_t numChannels, uint64_t numCols, uint64_t numRows, uint64_t channelOffset = 0)
+		{
+			if (numChannels != data.channels() || numCols != data.cols() || numRows != data.rows() || channelOffset >= data.channels()) {
+				return false;
+			}
+			
+			return RasterIO::windowToBuffer<PrimitiveTy>(band, data, RasterWindow(0, 0, (int)(numCols), (int)(numRows)), channelOffset);
+		}
+		
+		//Performs the GDALRasterBand::RasterIO() call to read a window of the band into the specified channel of an in-memory buffer whose dimensions match the window
+		//(For planar buffers the channel is contiguous, so GDAL can copy whole rows rather than scattering each pixel)
+		template <typename PrimitiveTy>
+		static inline bool windowToBuffer(GDALRasterBand* band, RasterData<PrimitiveTy>& data, const RasterWindow& window, uint64_t channelOffset = 0)
 		{
 			GDALDataType dtype = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
 			CPLErr result = band->RasterIO(
 				GF_Read,
-				0,
-				0,
-				numCols,
-				numRows,
-				data.getBuffer() + channelOffset,
-				numCols,
-				numRows,
+				window.x,
+				window.y,
+				window.width,
+				window.height,
+				data.getBuffer() + (channelOffset * data.channelSpacing()),
+				window.width,
+				window.height,
 				dtype,
-				sizeof(PrimitiveTy) * numChannels,
-				sizeof(PrimitiveTy) * numChannels * numCols
+				sizeof(PrimitiveTy) * data.pixelSpacing(),
+				sizeof(PrimitiveTy) * data.lineSpacing()
+			);
+			
+			return (result != CE_Failure);
+		}
+		
+		//Reads a window of the specified raster bands into consecutive channels of an in-memory buffer whose dimensions match the window, starting at the specified channel
+		//(When the buffer is interleaved and there is more than one band, each band is read contiguously into a scratch buffer one strip of block rows at a time, and the
+		// strips are interleaved into the buffer by the ChannelInterleaving kernels, which is considerably faster than having GDAL scatter each band into the buffer)
+		template <typename PrimitiveTy>
+		static inline bool bandsToBuffer(const std::vector<GDALRasterBand*>& bands, RasterData<PrimitiveTy>& data, const RasterWindow& window, uint64_t channelOffset = 0)
+		{
+			//Planar buffers and individual bands are read directly into the buffer
+			if (data.layout() == RasterLayout::Planar || bands.size() < 2)
+			{
+				for (size_t index = 0; index < bands.size(); ++index)
+				{
+					if (RasterIO::windowToBuffer<PrimitiveTy>(bands[index], data, window, channelOffset + index) == false) {
+						return false;
+					}
+				}
+				
+				return true;
+			}
+			
+			//Use strips of whole block rows that contain at least a quarter of a million pixels, so the scratch buffer stays modest without decoding blocks twice
+			uint64_t numRows = std::max(0, window.height);
+			uint64_t numCols = std::max(0, window.width);
+			if (numRows == 0 || numCols == 0) {
+				return true;
+			}
+			
+			TileGrid blocks = RasterIO::nativeBlockGrid(bands[0]);
+			uint64_t blockRows = blocks.tileHeight;
+			uint64_t minimumRows = ((1 << 18) + numCols - 1) / numCols;
+			uint64_t stripRows = std::min(numRows, ((std::max(minimumRows, blockRows) + blockRows - 1) / blockRows) * blockRows);
+			
+			//Read each strip of every band contiguously, then interleave the strip into the buffer
+			GDALDataType dtype = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
+			std::vector<PrimitiveTy> scratch(stripRows * numCols * bands.size());
+			std::vector<const PrimitiveTy*> planes(bands.size());
+			for (uint64_t row = 0; row < numRows; row += stripRows)
+			{
+				uint64_t rows = std::min(stripRows, numRows - row);
+				for (size_t index = 0; index < bands.size(); ++index)
+				{
+					PrimitiveTy* plane = scratch.data() + (index * rows * numCols);
+					CPLErr result = bands[index]->RasterIO(GF_Read, window.x, window.y + (int)(row), window.width, (int)(rows), plane, window.width, (int)(rows), dtype, 0, 0);
+					if (result == CE_Failure) {
+						return false;
+					}
+					
+					planes[index] = plane;
+				}
+				
+				ChannelInterleaving::interleave<PrimitiveTy>(planes.data(), bands.size(), data.getBuffer() + (row * data.lineSpacing()) + channelOffset, data.pixelSpacing(), rows * numCols);
+			}
+			
+			return true;
+		}
+		
+		//Performs a single GDALDataset::RasterIO() call to read a window of the specified bands into consecutive channels of an in-memory buffer
+		//whose dimensions match the window (for pixel-interleaved datasets this decodes each block once, rather than once for every band)
+		template <typename PrimitiveTy>
+		static inline bool datasetToBuffer(GDALDataset* dataset, RasterData<PrimitiveTy>& data, const std::vector<unsigned int>& bands, const RasterWindow& window, uint64_t channelOffset = 0)
+		{
+			GDALDataType dtype = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
+			std::vector<int> bandMap(bands.begin(), bands.end());
+			CPLErr result = dataset->RasterIO(
+				GF_Read,
+				window.x,
+				window.y,
+				window.width,
+				window.height,
+				data.getBuffer() + (channelOffset * data.channelSpacing()),
+				window.width,
+				window.height,
+				dtype,
+				(int)(bandMap.size()),
+				bandMap.data(),
+				sizeof(PrimitiveTy) * data.pixelSpacing(),
+				sizeof(PrimitiveTy) * data.lineSpacing(),
+				sizeof(PrimitiveTy) * data.channelSpacing(),
+				nullptr
+			);
+			
+			return (result != CE_Failure);
+		}
+		
+		//Performs a single GDALDataset::RasterIO() call to read a window of the specified bands into the channels of a view whose dimensions match the window
+		template <typename PrimitiveTy>
+		static inline bool datasetToView(GDALDataset* dataset, const RasterView<PrimitiveTy>& view, const std::vector<unsigned int>& bands, const RasterWindow& window)
+		{
+			GDALDataType dtype = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
+			std::vector<int> bandMap(bands.begin(), bands.end());
+			CPLErr result = dataset->RasterIO(
+				GF_Read,
+				window.x,
+				window.y,
+				window.width,
+				window.height,
+				view.getBuffer(),
+				window.width,
+				window.height,
+				dtype,
+				(int)(bandMap.size()),
+				bandMap.data(),
+				sizeof(PrimitiveTy) * view.pixelSpacing(),
+				sizeof(PrimitiveTy) * view.lineSpacing(),
+				sizeof(PrimitiveTy) * view.channelSpacing(),
+				nullptr
+			);
+			
+			return (result != CE_Failure);
+		}
+		
+		//Performs a single GDALDataset::RasterIO() call to write the channels of a view to a window of the dataset's raster bands
+		template <typename PrimitiveTy>
+		static inline bool viewToDataset(GDALDataset* dataset, const RasterView<PrimitiveTy>& view, const RasterWindow& window)
+		{
+			GDALDataType dtype = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
+			CPLErr result = dataset->RasterIO(
+				GF_Write,
+				window.x,
+				window.y,
+				window.width,
+				window.height,
+				view.getBuffer(),
+				window.width,
+				window.height,
+				dtype,
+				(int)(view.channels()),
+				nullptr,
+				sizeof(PrimitiveTy) * view.pixelSpacing(),
+				sizeof(PrimitiveTy) * view.lineSpacing(),
+				sizeof(PrimitiveTy) * view.channelSpacing(),
+				nullptr
+			);
+			
+			return (result != CE_Failure);
+		}
+		
+		//Determines if the bands of a dataset are stored pixel-interleaved, based on its image structure metadata
+		static inline bool isPixelInterleaved(GDALDataset* dataset)
+		{
+			const char* interleave = dataset->GetMetadataItem("INTERLEAVE", "IMAGE_STRUCTURE");
+			return interleave != nullptr && std::string(interleave) == "PIXEL";
+		}
+		
+		//Performs a single GDALDataset::RasterIO() call to write every channel of the rows of an in-memory buffer that start at the specified row to a window of the dataset,
+		//whose raster bands correspond to the channels of the buffer (the buffer must have the same width as the window)
+		//(Interleaved buffers are deinterleaved into a scratch buffer by the ChannelInterleaving kernels first unless the dataset is also pixel-interleaved,
+		// so that GDAL copies each band contiguously rather than gathering it from the buffer one pixel at a time)
+		template <typename PrimitiveTy>
+		static inline bool bufferToDataset(GDALDataset* dataset, const RasterData<PrimitiveTy>& data, const RasterWindow& window, uint64_t firstRow = 0)
+		{
+			uint64_t numChannels = data.channels();
+			const PrimitiveTy* buffer = data.getBuffer() + (firstRow * data.lineSpacing());
+			GSpacing pixelSpace = sizeof(PrimitiveTy) * data.pixelSpacing();
+			GSpacing lineSpace = sizeof(PrimitiveTy) * data.lineSpacing();
+			GSpacing bandSpace = sizeof(PrimitiveTy) * data.channelSpacing();
+			
+			//Deinterleave the rows into separate planes if required
+			std::vector<PrimitiveTy> scratch;
+			if (data.layout() == RasterLayout::Interleaved && numChannels > 1 && RasterIO::isPixelInterleaved(dataset) == false)
+			{
+				uint64_t pixels = (uint64_t)(window.width) * window.height;
+				scratch.resize(pixels * numChannels);
+				std::vector<PrimitiveTy*> planes;
+				for (uint64_t channel = 0; channel < numChannels; ++channel) {
+					planes.push_back(scratch.data() + (channel * pixels));
+				}
+				
+				ChannelInterleaving::deinterleave<PrimitiveTy>(buffer, numChannels, planes.data(), numChannels, pixels);
+				buffer = scratch.data();
+				pixelSpace = sizeof(PrimitiveTy);
+				lineSpace = sizeof(PrimitiveTy) * window.width;
+				bandSpace = sizeof(PrimitiveTy) * pixels;
+			}
+			
+			GDALDataType dtype = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
+			CPLErr result = dataset->RasterIO(
+				GF_Write,
+				window.x,
+				window.y,
+				window.width,
+				window.height,
+				(void*)(buffer),
+				window.width,
+				window.height,
+				dtype,
+				(int)(numChannels),
+				nullptr,
+				pixelSpace,
+				lineSpace,
+				bandSpace,
+				nullptr
 			);
 			
 			return (result != CE_Failure);
 		}
 		
 		//Performs the GDALRasterBand::RasterIO() call to write data to the band from an in-memory buffer
+		//(The spacing of the buffer is determined by its layout, so numChannels is only retained for compatibility and must match the buffer's channel count)
+		template <typename PrimitiveTy>
+		static inline bool bufferToBand(GDALRasterBand* band, const RasterData<PrimitiveTy>& data, uint64_t numChannels, uint64_t numCols, uint64_t numRows, uint64_t channelOffset = 0) {
+			return RasterIO::bufferToWindow<PrimitiveTy>(band, data, RasterWindow(0, 0, (int)(numCols), (int)(numRows)), channelOffset);
+		}
+		
+		//Performs the GDALRasterBand::RasterIO() call to write the specified channel of an in-memory buffer whose dimensions match the window to a window of the band
 		template <typename PrimitiveTy>
-		static inline bool bufferToBand(GDALRasterBand* band, const RasterData<PrimitiveTy>& data, uint64_t numChannels, uint64_t numCols, uint64_t numRows, uint64_t channelOffset = 0)
+		static inline bool bufferToWindow(GDALRasterBand* band, const RasterData<PrimitiveTy>& data, const RasterWindow& window, uint64_t channelOffset = 0)
 		{
 			GDALDataType dtype = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
 			CPLErr result = band->RasterIO(
 				GF_Write,
-				0,
-				0,
-				numCols,
-				numRows,
-				(void*)(data.getBuffer() + channelOffset),
-				numCols,
-				numRows,
+				window.x,
+				window.y,
+				window.width,
+				window.height,
+				(void*)(data.getBuffer() + (channelOffset * data.channelSpacing())),
+				window.width,
+				window.height,
 				dtype,
-				sizeof(PrimitiveTy) * numChannels,
-				sizeof(PrimitiveTy) * numChannels * numCols
+				sizeof(PrimitiveTy) * data.pixelSpacing(),
+				sizeof(PrimitiveTy) * data.lineSpacing()
 			);
 			
 			return (result != CE_Failure);
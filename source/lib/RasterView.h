@@ -0,0 +1,143 @@
+#ifndef _MERGETIFF_RASTER_VIEW
+#define _MERGETIFF_RASTER_VIEW
+
+#include "ErrorHandling.h"
+#include "RasterData.h"
+#include "RasterWindow.h"
+
+#include <stdint.h>
+
+namespace mergetiff {
+
+//A non-owning view of a rectangular region and a range of the channels of a raster buffer, with arbitrary spacing between pixels, rows and channels
+//(Views never allocate or copy pixels, so regions of interest and channel subsets can be passed to RasterIO and wrapRasterData() directly.
+// Views are cheap to copy, and the buffer that a view refers to must outlive it.)
+template <typename PrimitiveTy>
+class RasterView
+{
+	public:
+		
+		//Creates an empty view
+		RasterView() : _data(nullptr), _channels(0), _rows(0), _cols(0), _pixelSpacing(0), _lineSpacing(0), _channelSpacing(0) {}
+		
+		//Creates a view of an arbitrary buffer, with the spacing between adjacent pixels, rows and channels specified in elements
+		RasterView(PrimitiveTy* data, uint64_t channels, uint64_t rows, uint64_t cols, uint64_t pixelSpacing, uint64_t lineSpacing, uint64_t channelSpacing) :
+			_data(data),
+			_channels(channels),
+			_rows(rows),
+			_cols(cols),
+			_pixelSpacing(pixelSpacing),
+			_lineSpacing(lineSpacing),
+			_channelSpacing(channelSpacing)
+		{}
+		
+		//Creates a view of the whole of a RasterData object, in whichever layout it uses
+		RasterView(RasterData<PrimitiveTy>& data) :
+			_data(data.getBuffer()),
+			_channels(data.channels()),
+			_rows(data.rows()),
+			_cols(data.cols()),
+			_pixelSpacing(data.pixelSpacing()),
+			_lineSpacing(data.lineSpacing()),
+			_channelSpacing(data.channelSpacing())
+		{}
+		
+		//Determines if the view refers to a buffer
+		operator bool() const {
+			return this->_data != nullptr;
+		}
+		
+		//Returns the number of channels in the view
+		uint64_t channels() const {
+			return this->_channels;
+		}
+		
+		//Returns the number of rows in the view
+		uint64_t rows() const {
+			return this->_rows;
+		}
+		
+		//Returns the number of columns in the view
+		uint64_t cols() const {
+			return this->_cols;
+		}
+		
+		//Returns the number of elements between adjacent pixels in the same row and channel
+		uint64_t pixelSpacing() const {
+			return this->_pixelSpacing;
+		}
+		
+		//Returns the number of elements between adjacent rows in the same channel
+		uint64_t lineSpacing() const {
+			return this->_lineSpacing;
+		}
+		
+		//Returns the number of elements between the same pixel in adjacent channels
+		uint64_t channelSpacing() const {
+			return this->_channelSpacing;
+		}
+		
+		//Retrieves the pointer to the first channel of the top-left pixel of the view
+		PrimitiveTy* getBuffer() const {
+			return this->_data;
+		}
+		
+		//Retrieves a reference to the specified channel of the specified pixel
+		PrimitiveTy& pixelComponent(uint64_t y, uint64_t x, uint64_t channel) const {
+			return this->_data[(y * this->_lineSpacing) + (x * this->_pixelSpacing) + (channel * this->_channelSpacing)];
+		}
+		
+		//Returns a view of a rectangular region of this view, which must lie entirely within it
+		RasterView region(const RasterWindow& window) const
+		{
+			if (window.within((int)(this->_cols), (int)(this->_rows)) == false) {
+				return ErrorHandling::handleError<RasterView>("window does not lie within the raster view");
+			}
+			
+			return RasterView(
+				&(this->pixelComponent(window.y, window.x, 0)),
+				this->_channels,
+				window.height,
+				window.width,
+				this->_pixelSpacing,
+				this->_lineSpacing,
+				this->_channelSpacing
+			);
+		}
+		
+		//Returns a view of the specified number of consecutive channels of this view, starting at the specified channel
+		RasterView channelRange(uint64_t first, uint64_t count) const
+		{
+			if (count == 0 || first + count > this->_channels) {
+				return ErrorHandling::handleError<RasterView>("invalid channel range for raster view");
+			}
+			
+			return RasterView(
+				this->_data + (first * this->_channelSpacing),
+				count,
+				this->_rows,
+				this->_cols,
+				this->_pixelSpacing,
+				this->_lineSpacing,
+				this->_channelSpacing
+			);
+		}
+		
+		//Returns a view of an individual channel of this view
+		RasterView channel(uint64_t index) const {
+			return this->channelRange(index, 1);
+		}
+		
+	private:
+		PrimitiveTy* _data;
+		uint64_t _channels;
+		uint64_t _rows;
+		uint64_t _cols;
+		uint64_t _pixelSpacing;
+		uint64_t _lineSpacing;
+		uint64_t _channelSpacing;
+};
+
+} //End namespace mergetiff
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef _MERGETIFF_RASTER_WINDOW
+#define _MERGETIFF_RASTER_WINDOW
+
+#include <stdint.h>
+
+namespace mergetiff {
+
+//Represents a rectangular region of a raster, in pixel coordinates
+class RasterWindow
+{
+	public:
+		
+		RasterWindow() : x(0), y(0), width(0), height(0) {}
+		RasterWindow(int x, int y, int width, int height) : x(x), y(y), width(width), height(height) {}
+		
+		//Returns the number of pixels in the window
+		uint64_t pixels() const {
+			return (uint64_t)(this->width) * (uint64_t)(this->height);
+		}
+		
+		//Determines if the window is non-empty and lies entirely within a raster of the specified dimensions
+		bool within(int rasterWidth, int rasterHeight) const {
+			return this->x >= 0 && this->y >= 0 && this->width > 0 && this->height > 0 && this->x <= rasterWidth - this->width && this->y <= rasterHeight - this->height;
+		}
+		
+		int x;
+		int y;
+		int width;
+		int height;
+};
+
+//Divides a raster into a grid of tiles in row-major order, with partial tiles along the right and bottom edges
+class TileGrid
+{
+	public:
+		
+		TileGrid(int rasterWidth, int rasterHeight, int tileWidth, int tileHeight) :
+			rasterWidth(rasterWidth),
+			rasterHeight(rasterHeight),
+			tileWidth(tileWidth),
+			tileHeight(tileHeight)
+		{}
+		
+		//Returns the number of tiles across the width of the raster
+		uint64_t tilesAcross() const {
+			return (this->rasterWidth + this->tileWidth - 1) / this->tileWidth;
+		}
+		
+		//Returns the number of tiles down the height of the raster
+		uint64_t tilesDown() const {
+			return (this->rasterHeight + this->tileHeight - 1) / this->tileHeight;
+		}
+		
+		//Returns the total number of tiles in the grid
+		uint64_t numTiles() const {
+			return this->tilesAcross() * this->tilesDown();
+		}
+		
+		//Returns the window covered by the tile with the specified index
+		RasterWindow window(uint64_t tileIndex) const
+		{
+			int x = (int)(tileIndex % this->tilesAcross()) * this->tileWidth;
+			int y = (int)(tileIndex / this->tilesAcross()) * this->tileHeight;
+			return RasterWindow(
+				x,
+				y,
+				(x + this->tileWidth > this->rasterWidth) ? (this->rasterWidth - x) : this->tileWidth,
+				(y + this->tileHeight > this->rasterHeight) ? (this->rasterHeight - y) : this->tileHeight
+			);
+		}
+		
+		int rasterWidth;
+		int rasterHeight;
+		int tileWidth;
+		int tileHeight;
+};
+
+} //End namespace mergetiff
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef _MERGETIFF_THREAD_POOL
+#define _MERGETIFF_THREAD_POOL
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace mergetiff {
+
+//A simple fixed-size pool of worker threads that execute tasks in submission order
+class ThreadPool
+{
+	public:
+		
+		//Creates a pool with the specified number of worker threads (zero selects the number of hardware threads)
+		inline ThreadPool(unsigned int numThreads = 0) : stopping(false)
+		{
+			numThreads = ThreadPool::resolveThreadCount(numThreads);
+			for (unsigned int index = 0; index < numThreads; ++index) {
+				this->workers.emplace_back(&ThreadPool::workerLoop, this, index);
+			}
+		}
+		
+		//ThreadPool objects cannot be copied
+		ThreadPool(const ThreadPool& other) = delete;
+		ThreadPool& operator=(const ThreadPool& other) = delete;
+		
+		//Completes any pending tasks and then stops the worker threads
+		inline ~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->stopping = true;
+			}
+			
+			this->condition.notify_all();
+			for (auto& worker : this->workers) {
+				worker.join();
+			}
+		}
+		
+		//Queues a task for execution and returns a future that will hold its result
+		template <typename FuncTy>
+		inline std::future<typename std::result_of<FuncTy()>::type> submit(FuncTy func)
+		{
+			typedef typename std::result_of<FuncTy()>::type ResultTy;
+			auto task = std::make_shared< std::packaged_task<ResultTy()> >(func);
+			std::future<ResultTy> result = task->get_future();
+			
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->tasks.push([task]() { (*task)(); });
+			}
+			
+			this->condition.notify_one();
+			return result;
+		}
+		
+		//Returns the number of worker threads in the pool
+		inline unsigned int size() const {
+			return (unsigned int)(this->workers.size());
+		}
+		
+		//Resolves a requested thread count, where zero selects the number of hardware threads
+		static inline unsigned int resolveThreadCount(unsigned int requested)
+		{
+			if (requested > 0) {
+				return requested;
+			}
+			
+			unsigned int hardwareThreads = std::thread::hardware_concurrency();
+			return (hardwareThreads > 0) ? hardwareThreads : 1;
+		}
+		
+		//Returns the index of the calling worker thread within its pool, or -1 if the calling thread is not a worker thread
+		//(This allows tasks to use per-thread state, such as accumulators, without holding one copy per task)
+		static inline int workerIndex() {
+			return ThreadPool::currentWorker();
+		}
+		
+	private:
+		
+		//Provides access to the index of the calling worker thread
+		static inline int& currentWorker()
+		{
+			static thread_local int index = -1;
+			return index;
+		}
+		
+		//The main loop for each of the worker threads
+		inline void workerLoop(unsigned int index)
+		{
+			ThreadPool::currentWorker() = (int)(index);
+			while (true)
+			{
+				std::function<void()> task;
+				
+				{
+					//Wait until a task is available or the pool is stopping
+					std::unique_lock<std::mutex> lock(this->mutex);
+					this->condition.wait(lock, [this]() { return this->stopping || !this->tasks.empty(); });
+					
+					//Only exit once all pending tasks have been completed
+					if (this->tasks.empty()) {
+						return;
+					}
+					
+					task = std::move(this->tasks.front());
+					this->tasks.pop();
+				}
+				
+				task();
+			}
+		}
+		
+		std::vector<std::thread> workers;
+		std::queue< std::function<void()> > tasks;
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool stopping;
+};
+
+} //End namespace mergetiff
+
+#endif
@@ -0,0 +1,288 @@
+#ifndef _MERGETIFF_TIFF_DIRECTORY
+#define _MERGETIFF_TIFF_DIRECTORY
+
+#include <cpl_vsi.h>
+#include <stdint.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace mergetiff {
+
+//Provides minimal access to the first image file directory (IFD) of a classic TIFF or BigTIFF file,
+//sufficient to inspect its tile structure and to read or patch the locations of its tiles
+class TiffDirectory
+{
+	public:
+		
+		//The TIFF tags that are inspected when copying raw tiles
+		enum Tag
+		{
+			ImageWidth = 256,
+			ImageLength = 257,
+			BitsPerSample = 258,
+			Compression = 259,
+			SamplesPerPixel = 277,
+			PlanarConfiguration = 284,
+			Predictor = 317,
+			TileWidth = 322,
+			TileLength = 323,
+			TileOffsets = 324,
+			TileByteCounts = 325,
+			SampleFormat = 339
+		};
+		
+		TiffDirectory() : bigEndian(false), bigTiff(false) {}
+		
+		//Parses the first IFD of the supplied file, returning false if it is not a valid TIFF file
+		inline bool read(VSILFILE* file)
+		{
+			this->entries.clear();
+			
+			//Parse the header to determine the byte order and TIFF variant
+			uint8_t header[16];
+			if (VSIFSeekL(file, 0, SEEK_SET) != 0 || VSIFReadL(header, 1, 16, file) < 8) {
+				return false;
+			}
+			
+			if (header[0] == 'I' && header[1] == 'I') { this->bigEndian = false; }
+			else if (header[0] == 'M' && header[1] == 'M') { this->bigEndian = true; }
+			else { return false; }
+			
+			uint64_t version = this->decode(header + 2, 2);
+			if (version != 42 && version != 43) {
+				return false;
+			}
+			
+			this->bigTiff = (version == 43);
+			uint64_t directoryOffset = this->bigTiff ? this->decode(header + 8, 8) : this->decode(header + 4, 4);
+			
+			//Read the number of entries in the IFD
+			uint8_t buffer[20];
+			unsigned int countSize = this->bigTiff ? 8 : 2;
+			unsigned int entrySize = this->bigTiff ? 20 : 12;
+			if (VSIFSeekL(file, directoryOffset, SEEK_SET) != 0 || VSIFReadL(buffer, 1, countSize, file) != countSize) {
+				return false;
+			}
+			
+			//Parse each of the entries, resolving the file offset of each entry's values
+			uint64_t numEntries = this->decode(buffer, countSize);
+			for (uint64_t index = 0; index < numEntries; ++index)
+			{
+				uint64_t entryOffset = directoryOffset + countSize + (index * entrySize);
+				if (VSIFSeekL(file, entryOffset, SEEK_SET) != 0 || VSIFReadL(buffer, 1, entrySize, file) != entrySize) {
+					return false;
+				}
+				
+				Entry entry;
+				entry.entryOffset = entryOffset;
+				uint16_t tag = (uint16_t)(this->decode(buffer, 2));
+				entry.type = (uint16_t)(this->decode(buffer + 2, 2));
+				entry.count = this->bigTiff ? this->decode(buffer + 4, 8) : this->decode(buffer + 4, 4);
+				
+				//Values that fit within the entry are stored inline, otherwise the entry holds their offset
+				unsigned int inlineSize = this->bigTiff ? 8 : 4;
+				unsigned int valueFieldOffset = this->bigTiff ? 12 : 8;
+				if (entry.count * TiffDirectory::typeSize(entry.type) <= inlineSize) {
+					entry.valueOffset = entryOffset + valueFieldOffset;
+				}
+				else {
+					entry.valueOffset = this->decode(buffer + valueFieldOffset, inlineSize);
+				}
+				
+				this->entries[tag] = entry;
+			}
+			
+			return true;
+		}
+		
+		//Determines if the file is a BigTIFF file
+		bool isBigTiff() const {
+			return this->bigTiff;
+		}
+		
+		//Determines if the file uses big-endian byte order
+		bool isBigEndian() const {
+			return this->bigEndian;
+		}
+		
+		//Determines if the IFD contains the specified tag
+		bool hasTag(uint16_t tag) const {
+			return this->entries.find(tag) != this->entries.end();
+		}
+		
+		//Reads all of the values of an integer tag
+		inline bool readValues(VSILFILE* file, uint16_t tag, std::vector<uint64_t>& values) const
+		{
+			auto entry = this->entries.find(tag);
+			unsigned int size = (entry != this->entries.end()) ? TiffDirectory::typeSize(entry->second.type) : 0;
+			if (size == 0 || TiffDirectory::isInteger(entry->second.type) == false) {
+				return false;
+			}
+			
+			std::vector<uint8_t> buffer(entry->second.count * size);
+			if (VSIFSeekL(file, entry->second.valueOffset, SEEK_SET) != 0 || VSIFReadL(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+				return false;
+			}
+			
+			values.resize(entry->second.count);
+			for (uint64_t index = 0; index < entry->second.count; ++index) {
+				values[index] = this->decode(buffer.data() + (index * size), size);
+			}
+			
+			return true;
+		}
+		
+		//Reads the first value of an integer tag, returning the default value if the tag is not present
+		inline uint64_t readValue(VSILFILE* file, uint16_t tag, uint64_t defaultValue) const
+		{
+			std::vector<uint64_t> values;
+			if (this->readValues(file, tag, values) == false || values.empty()) {
+				return defaultValue;
+			}
+			
+			return values[0];
+		}
+		
+		//Overwrites all of the values of an integer tag, widening the tag's type if any of the values cannot be represented by its existing type
+		//(libtiff stores tile locations using the narrowest type that fits the values it wrote, so widened values are appended to the end of the file
+		// as LONG values in classic TIFF files or LONG8 values in BigTIFF files, and the IFD entry is updated to reference them)
+		inline bool writeValues(VSILFILE* file, uint16_t tag, const std::vector<uint64_t>& values)
+		{
+			auto entry = this->entries.find(tag);
+			unsigned int size = (entry != this->entries.end()) ? TiffDirectory::typeSize(entry->second.type) : 0;
+			if (size == 0 || TiffDirectory::isInteger(entry->second.type) == false || values.size() != entry->second.count) {
+				return false;
+			}
+			
+			uint64_t maximum = 0;
+			for (auto value : values) {
+				maximum = std::max(maximum, value);
+			}
+			
+			//If the existing type can represent every value then overwrite the values in place
+			if (size == 8 || (maximum >> (size * 8)) == 0)
+			{
+				std::vector<uint8_t> buffer = this->encodeValues(values, size);
+				return VSIFSeekL(file, entry->second.valueOffset, SEEK_SET) == 0 && VSIFWriteL(buffer.data(), 1, buffer.size(), file) == buffer.size();
+			}
+			
+			//Otherwise use the widest unsigned integer type that the TIFF variant supports
+			uint16_t wideType = this->bigTiff ? 16 : 4;
+			unsigned int wideSize = TiffDirectory::typeSize(wideType);
+			if (wideSize < 8 && (maximum >> (wideSize * 8)) != 0) {
+				return false;
+			}
+			
+			//Values that fit within the entry are stored inline, otherwise they are appended to the end of the file at an 8-byte boundary
+			unsigned int countSize = this->bigTiff ? 8 : 4;
+			unsigned int inlineSize = this->bigTiff ? 8 : 4;
+			std::vector<uint8_t> buffer = this->encodeValues(values, wideSize);
+			std::vector<uint8_t> valueField(inlineSize, 0);
+			uint64_t valueOffset = entry->second.entryOffset + 4 + countSize;
+			if (buffer.size() <= inlineSize) {
+				std::copy(buffer.begin(), buffer.end(), valueField.begin());
+			}
+			else
+			{
+				if (VSIFSeekL(file, 0, SEEK_END) != 0) {
+					return false;
+				}
+				
+				uint64_t end = VSIFTellL(file);
+				std::vector<uint8_t> padding((8 - (end % 8)) % 8, 0);
+				valueOffset = end + padding.size();
+				if (VSIFWriteL(padding.data(), 1, padding.size(), file) != padding.size() || VSIFWriteL(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+					return false;
+				}
+				
+				this->encode(valueOffset, valueField.data(), inlineSize);
+			}
+			
+			//Rewrite the type, count and value field of the IFD entry
+			std::vector<uint8_t> fields(2 + countSize);
+			this->encode(wideType, fields.data(), 2);
+			this->encode(values.size(), fields.data() + 2, countSize);
+			fields.insert(fields.end(), valueField.begin(), valueField.end());
+			if (VSIFSeekL(file, entry->second.entryOffset + 2, SEEK_SET) != 0 || VSIFWriteL(fields.data(), 1, fields.size(), file) != fields.size()) {
+				return false;
+			}
+			
+			entry->second.type = wideType;
+			entry->second.valueOffset = valueOffset;
+			return true;
+		}
+		
+	private:
+		
+		//Returns the size in bytes of a value of the specified TIFF field type (zero for unknown types)
+		static inline unsigned int typeSize(uint16_t type)
+		{
+			switch (type)
+			{
+				case 1: case 2: case 6: case 7: return 1;
+				case 3: case 8: return 2;
+				case 4: case 9: case 11: case 13: return 4;
+				case 5: case 10: case 12: case 16: case 17: case 18: return 8;
+				default: return 0;
+			}
+		}
+		
+		//Determines if the specified TIFF field type is an unsigned integer type
+		static inline bool isInteger(uint16_t type) {
+			return type == 1 || type == 3 || type == 4 || type == 16;
+		}
+		
+		//Decodes an unsigned integer of the specified size using the file's byte order
+		inline uint64_t decode(const uint8_t* data, unsigned int size) const
+		{
+			uint64_t value = 0;
+			for (unsigned int index = 0; index < size; ++index)
+			{
+				unsigned int shift = this->bigEndian ? ((size - 1 - index) * 8) : (index * 8);
+				value |= ((uint64_t)(data[index]) << shift);
+			}
+			
+			return value;
+		}
+		
+		//Encodes a list of unsigned integers of the specified size using the file's byte order
+		inline std::vector<uint8_t> encodeValues(const std::vector<uint64_t>& values, unsigned int size) const
+		{
+			std::vector<uint8_t> buffer(values.size() * size);
+			for (size_t index = 0; index < values.size(); ++index) {
+				this->encode(values[index], buffer.data() + (index * size), size);
+			}
+			
+			return buffer;
+		}
+		
+		//Encodes an unsigned integer of the specified size using the file's byte order
+		inline void encode(uint64_t value, uint8_t* data, unsigned int size) const
+		{
+			for (unsigned int index = 0; index < size; ++index)
+			{
+				unsigned int shift = this->bigEndian ? ((size - 1 - index) * 8) : (index * 8);
+				data[index] = (uint8_t)((value >> shift) & 0xff);
+			}
+		}
+		
+		//Represents an IFD entry, with the file offsets of the entry itself and of its values
+		class Entry
+		{
+			public:
+				Entry() : type(0), count(0), entryOffset(0), valueOffset(0) {}
+				uint16_t type;
+				uint64_t count;
+				uint64_t entryOffset;
+				uint64_t valueOffset;
+		};
+		
+		bool bigEndian;
+		bool bigTiff;
+		std::map<uint16_t, Entry> entries;
+};
+
+} //End namespace mergetiff
+
+#endif
@@ -0,0 +1,247 @@
+#ifndef _MERGETIFF_TILE_PASSTHROUGH
+#define _MERGETIFF_TILE_PASSTHROUGH
+
+#include "ArgsArray.h"
+#include "TiffDirectory.h"
+
+#include <cpl_vsi.h>
+#include <gdal.h>
+#include <gdal_priv.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace mergetiff {
+
+//Copies the compressed tiles of GeoTiff raster bands directly into a tiled GeoTiff output without decoding and re-encoding them
+//(GDAL provides no public API for writing raw tiles, so the tiles are appended to the closed output file and its tile offsets are patched)
+class TilePassthrough
+{
+	public:
+		
+		//Describes the locations of the compressed tiles of an input band, in the same row-major order as the output tiles
+		class SourceTiles
+		{
+			public:
+				
+				//Returns the total size of the compressed tiles in bytes
+				uint64_t totalBytes() const
+				{
+					uint64_t total = 0;
+					for (auto byteCount : this->byteCounts) {
+						total += byteCount;
+					}
+					
+					return total;
+				}
+				
+				std::string filename;
+				std::vector<uint64_t> offsets;
+				std::vector<uint64_t> byteCounts;
+		};
+		
+		//Determines if the compressed tiles of a raster band can be copied verbatim into a band-interleaved GeoTiff
+		//created with the specified creation options and block size, retrieving the locations of the tiles if so
+		static inline bool inspectBand(GDALRasterBand* band, const ArgsArray& creationOptions, unsigned int blockSize, SourceTiles& tiles)
+		{
+			//Only bands read directly from the main image of a GeoTiff file are eligible
+			GDALDataset* dataset = band->GetDataset();
+			if (dataset == nullptr || dataset->GetDriver() == nullptr || std::string(dataset->GetDriver()->GetDescription()) != "GTiff") {
+				return false;
+			}
+			if (band->GetBand() < 1 || dataset->GetRasterBand(band->GetBand()) != band) {
+				return false;
+			}
+			
+			//Only codecs that store each tile as a self-contained stream without any additional tables are supported
+			uint64_t compression = TilePassthrough::compressionCode(creationOptions.value("COMPRESS", "NONE"));
+			uint64_t predictor = std::stoul(creationOptions.value("PREDICTOR", "1"));
+			if (compression == 0) {
+				return false;
+			}
+			
+			VSILFILE* file = VSIFOpenL(dataset->GetDescription(), "rb");
+			if (file == nullptr) {
+				return false;
+			}
+			
+			//Verify that the tile layout, codec and sample encoding of the file match those of the output
+			TiffDirectory directory;
+			bool compatible = directory.read(file) && directory.isBigEndian() == TilePassthrough::hostIsBigEndian();
+			if (compatible == true)
+			{
+				uint64_t inputCompression = directory.readValue(file, TiffDirectory::Compression, 1);
+				uint64_t samplesPerPixel = directory.readValue(file, TiffDirectory::SamplesPerPixel, 1);
+				GDALDataType dtype = band->GetRasterDataType();
+				compatible =
+					(inputCompression == compression || (inputCompression == 32946 && compression == 8)) &&
+					directory.readValue(file, TiffDirectory::Predictor, 1) == predictor &&
+					directory.readValue(file, TiffDirectory::ImageWidth, 0) == (uint64_t)(band->GetXSize()) &&
+					directory.readValue(file, TiffDirectory::ImageLength, 0) == (uint64_t)(band->GetYSize()) &&
+					directory.readValue(file, TiffDirectory::TileWidth, 0) == blockSize &&
+					directory.readValue(file, TiffDirectory::TileLength, 0) == blockSize &&
+					directory.readValue(file, TiffDirectory::BitsPerSample, 1) == (uint64_t)(GDALGetDataTypeSizeBits(dtype)) &&
+					directory.readValue(file, TiffDirectory::SampleFormat, 1) == TilePassthrough::sampleFormat(dtype) &&
+					(samplesPerPixel == 1 || directory.readValue(file, TiffDirectory::PlanarConfiguration, 1) == 2) &&
+					(uint64_t)(band->GetBand()) <= samplesPerPixel;
+			}
+			
+			//Retrieve the locations of the band's tiles, which form a contiguous range when samples are stored separately
+			std::vector<uint64_t> offsets;
+			std::vector<uint64_t> byteCounts;
+			uint64_t tilesPerBand = TilePassthrough::tilesPerBand(band->GetXSize(), band->GetYSize(), blockSize);
+			uint64_t firstTile = (uint64_t)(band->GetBand() - 1) * tilesPerBand;
+			compatible = compatible &&
+				directory.readValues(file, TiffDirectory::TileOffsets, offsets) &&
+				directory.readValues(file, TiffDirectory::TileByteCounts, byteCounts) &&
+				offsets.size() == byteCounts.size() &&
+				offsets.size() >= firstTile + tilesPerBand;
+			
+			VSIFCloseL(file);
+			if (compatible == false) {
+				return false;
+			}
+			
+			tiles.filename = dataset->GetDescription();
+			tiles.offsets.assign(offsets.begin() + firstTile, offsets.begin() + firstTile + tilesPerBand);
+			tiles.byteCounts.assign(byteCounts.begin() + firstTile, byteCounts.begin() + firstTile + tilesPerBand);
+			return true;
+		}
+		
+		//Appends the compressed tiles of the specified bands (keyed by zero-based band index) to a closed band-interleaved GeoTiff,
+		//updating the file's tile offsets to reference them (the tiles of these bands must not have been written by GDAL)
+		static inline bool copyTiles(const std::string& filename, int width, int height, unsigned int blockSize, const std::map<int, SourceTiles>& bands, GDALProgressFunc progressCallback, double progressStart, std::string& error)
+		{
+			VSILFILE* file = VSIFOpenL(filename.c_str(), "r+b");
+			if (file == nullptr)
+			{
+				error = "failed to open output dataset \"" + filename + "\" for tile copying";
+				return false;
+			}
+			
+			//Retrieve the existing tile locations of the output file
+			TiffDirectory directory;
+			std::vector<uint64_t> offsets;
+			std::vector<uint64_t> byteCounts;
+			bool success = directory.read(file) &&
+				directory.readValues(file, TiffDirectory::TileOffsets, offsets) &&
+				directory.readValues(file, TiffDirectory::TileByteCounts, byteCounts) &&
+				VSIFSeekL(file, 0, SEEK_END) == 0;
+			
+			error = (success == false) ? "failed to parse the tile structure of output dataset \"" + filename + "\"" : "";
+			
+			//Append the tiles of each band to the end of the file
+			uint64_t tilesPerBand = TilePassthrough::tilesPerBand(width, height, blockSize);
+			uint64_t totalTiles = tilesPerBand * bands.size();
+			uint64_t tilesCopied = 0;
+			uint64_t end = (success == true) ? VSIFTellL(file) : 0;
+			std::vector<uint8_t> buffer;
+			for (auto band = bands.begin(); band != bands.end() && success; ++band)
+			{
+				const SourceTiles& tiles = band->second;
+				VSILFILE* source = VSIFOpenL(tiles.filename.c_str(), "rb");
+				if (source == nullptr || offsets.size() < (uint64_t)(band->first + 1) * tilesPerBand)
+				{
+					error = "failed to copy compressed tiles from \"" + tiles.filename + "\"";
+					success = false;
+				}
+				
+				for (uint64_t tile = 0; tile < tilesPerBand && success; ++tile)
+				{
+					//Tiles that are absent from a sparse input remain absent in the output
+					uint64_t byteCount = tiles.byteCounts[tile];
+					uint64_t outputTile = (uint64_t)(band->first) * tilesPerBand + tile;
+					if (byteCount > 0)
+					{
+						buffer.resize(byteCount);
+						success =
+							VSIFSeekL(source, tiles.offsets[tile], SEEK_SET) == 0 &&
+							VSIFReadL(buffer.data(), 1, byteCount, source) == byteCount &&
+							VSIFWriteL(buffer.data(), 1, byteCount, file) == byteCount;
+						
+						if (success == false) {
+							error = "failed to copy compressed tiles from \"" + tiles.filename + "\"";
+						}
+					}
+					
+					offsets[outputTile] = (byteCount > 0) ? end : 0;
+					byteCounts[outputTile] = byteCount;
+					end += byteCount;
+					
+					//Report progress, allowing the callback to cancel the copy
+					++tilesCopied;
+					double progress = progressStart + (1.0 - progressStart) * (double)(tilesCopied) / (double)(totalTiles);
+					if (success && progressCallback != nullptr && progressCallback(progress, "", nullptr) == 0)
+					{
+						error = "merge operation was cancelled";
+						success = false;
+					}
+				}
+				
+				if (source != nullptr) {
+					VSIFCloseL(source);
+				}
+			}
+			
+			//Update the tile locations to reference the copied tiles
+			if (success == true)
+			{
+				success = directory.writeValues(file, TiffDirectory::TileOffsets, offsets) && directory.writeValues(file, TiffDirectory::TileByteCounts, byteCounts);
+				if (success == false) {
+					error = "failed to update the tile offsets of output dataset \"" + filename + "\"";
+				}
+			}
+			
+			VSIFCloseL(file);
+			return success;
+		}
+		
+		//Returns the number of tiles in each band of a raster with the specified dimensions
+		static inline uint64_t tilesPerBand(int width, int height, unsigned int blockSize) {
+			return (uint64_t)((width + blockSize - 1) / blockSize) * ((height + blockSize - 1) / blockSize);
+		}
+		
+	private:
+		
+		//Returns the TIFF compression tag value for a GeoTiff COMPRESS creation option, or zero if the codec cannot be copied verbatim
+		static inline uint64_t compressionCode(const std::string& compress)
+		{
+			if (compress == "NONE")     { return 1; }
+			if (compress == "LZW")      { return 5; }
+			if (compress == "DEFLATE")  { return 8; }
+			if (compress == "PACKBITS") { return 32773; }
+			if (compress == "LZMA")     { return 34925; }
+			if (compress == "ZSTD")     { return 50000; }
+			return 0;
+		}
+		
+		//Returns the TIFF sample format tag value for a GDAL datatype
+		static inline uint64_t sampleFormat(GDALDataType dtype)
+		{
+			switch (dtype)
+			{
+				case GDT_Int16:
+				case GDT_Int32:
+					return 2;
+				
+				case GDT_Float32:
+				case GDT_Float64:
+					return 3;
+				
+				default:
+					return 1;
+			}
+		}
+		
+		//Determines if the host uses big-endian byte order (GDAL creates GeoTiffs in the native byte order by default)
+		static inline bool hostIsBigEndian()
+		{
+			uint16_t probe = 1;
+			return *((uint8_t*)(&probe)) == 0;
+		}
+};
+
+} //End namespace mergetiff
+
+#endif
@@ -0,0 +1,868 @@
+#ifndef _MERGETIFF_TILED_MERGE
+#define _MERGETIFF_TILED_MERGE
+
+#include "ArgsArray.h"
+#include "BandExpression.h"
+#include "BandReaderPool.h"
+#include "BandStatistics.h"
+#include "CompressionTuning.h"
+#include "DatasetMetadata.h"
+#include "DatatypeConversion.h"
+#include "DriverOptions.h"
+#include "ErrorHandling.h"
+#include "MemoryBudget.h"
+#include "MergeOptions.h"
+#include "MergeStats.h"
+#include "OutputLayout.h"
+#include "PyramidReduction.h"
+#include "RasterGrid.h"
+#include "RasterWindow.h"
+#include "SmartPointers.h"
+#include "ThreadPool.h"
+#include "TilePassthrough.h"
+
+#include <cpl_conv.h>
+#include <cpl_vsi.h>
+#include <gdal.h>
+#include <gdal_priv.h>
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace mergetiff {
+
+//Implements the tiled, multi-threaded merge engine used by DatasetManagement::createMergedDataset()
+class TiledMerge
+{
+	public:
+		
+		//Merges the supplied raster bands into a new tiled GeoTiff dataset, reading tiles concurrently and writing them in order
+		//(If a statistics object is supplied then the time spent in each phase and the volume of data processed are added to it, along with the
+		// statistics of each output band if they were requested)
+		template <typename PrimitiveTy>
+		static inline GDALDatasetRef mergeBands(const std::string& filename, GDALDatasetRef& metadataDataset, const std::vector<GDALRasterBand*>& rasterBands, GDALProgressFunc progressCallback, const MergeOptions& options, MergeStats* stats = nullptr)
+		{
+			//Statistics are always gathered, and are discarded if the caller did not request them
+			MergeStats discardedStats;
+			MergeStats& report = (stats != nullptr) ? *stats : discardedStats;
+			Stopwatch totalTime;
+			
+			//Resolve the output layout and verify that the block size is valid for it (tiled GeoTiffs require multiples of 16)
+			OutputLayout layout = OutputLayout::resolve(options);
+			if (layout.tiled && layout.blockSize % 16 != 0) {
+				return ErrorHandling::handleError<GDALDatasetRef>("output tile size must be a multiple of 16");
+			}
+			
+			//Verify that a striped layout was not requested for Cloud Optimized GeoTiff output, which is always tiled
+			if (layout.tiled == false && options.format == OutputFormat::COG) {
+				return ErrorHandling::handleError<GDALDatasetRef>("Cloud Optimized GeoTiff output requires a tiled layout");
+			}
+			
+			//Attempt to retrieve a reference to the GeoTiff GDAL driver
+			GDALDriver* tiffDriver = ((GDALDriver*)GDALGetDriverByName("GTiff"));
+			if (tiffDriver == nullptr) {
+				return ErrorHandling::handleError<GDALDatasetRef>("failed to retrieve the GDAL GeoTiff driver handle");
+			}
+			
+			//Build the compression options for the output dataset, selecting a codec from a sample of the input tiles if requested
+			//(The layout options are added once it is known whether any compressed tiles will be copied)
+			GDALDataType dtype = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
+			CompressionProfile compression = CompressionTuning::resolve(options.compression, rasterBands, dtype, layout.blockSize);
+			ArgsArray creationOptions = DriverOptions::geoTiffOptions(dtype, compression, options.sparseOutput);
+			
+			//Determine the output grid, which is the grid of the first band unless the bands are being aligned
+			int numInputBands = (int)(rasterBands.size());
+			RasterGrid outputGrid;
+			if (options.alignment == GridAlignment::None)
+			{
+				outputGrid.width = rasterBands[0]->GetXSize();
+				outputGrid.height = rasterBands[0]->GetYSize();
+				for (auto band : rasterBands)
+				{
+					if (band->GetXSize() != outputGrid.width || band->GetYSize() != outputGrid.height) {
+						return ErrorHandling::handleError<GDALDatasetRef>("raster bands have differing dimensions, grid alignment is required to merge them");
+					}
+				}
+			}
+			else
+			{
+				outputGrid = RasterGrid::forBands(rasterBands, options.alignment);
+				if (outputGrid.width <= 0 || outputGrid.height <= 0) {
+					return ErrorHandling::handleError<GDALDatasetRef>("failed to compute the output grid for the supplied raster bands");
+				}
+			}
+			
+			//Determine how each of the input bands will be converted and aligned to the output
+			std::vector<InputBand> inputs;
+			bool requiresScratch = false;
+			for (size_t index = 0; index < rasterBands.size(); ++index)
+			{
+				InputBand input;
+				input.sourceType = rasterBands[index]->GetRasterDataType();
+				input.noDataValue = rasterBands[index]->GetNoDataValue(&input.hasNoData);
+				input.fillValue = input.hasNoData ? (double)(DatatypeConversion::saturate<PrimitiveTy>(input.noDataValue)) : 0.0;
+				if (index < options.bandTransforms.size()) {
+					input.transform = options.bandTransforms[index];
+				}
+				
+				//Bands with a value transformation are read in their native datatype and converted by our own kernels
+				if (input.transform.isIdentity() == false)
+				{
+					if (DatatypeConversion::isSupported(input.sourceType) == false) {
+						return ErrorHandling::handleError<GDALDatasetRef>("unsupported GDAL datatype in one or more raster bands");
+					}
+					
+					requiresScratch = true;
+				}
+				
+				//Bands whose grid differs from the output grid are offset and resampled as they are read
+				if (options.alignment != GridAlignment::None)
+				{
+					RasterGrid::fromBand(rasterBands[index], input.grid);
+					input.aligned = (input.grid.matches(outputGrid) == false);
+				}
+				
+				inputs.push_back(input);
+			}
+			
+			//Computed bands follow the input bands in the output, and are evaluated from the decoded input bands of each tile
+			//(Floating-point outputs use NaN as the "no data" value of a computed band, and other outputs use that of the first band it refers to that has one)
+			std::vector<BandExpression> expressions;
+			for (auto& text : options.bandExpressions)
+			{
+				BandExpression expression = BandExpression::compile(text);
+				if (!expression) {
+					return GDALDatasetRef();
+				}
+				if (expression.maxBand() > (unsigned int)(numInputBands)) {
+					return ErrorHandling::handleError<GDALDatasetRef>("band expression \"" + text + "\" refers to band b" + std::to_string(expression.maxBand()) + ", but only " + std::to_string(numInputBands) + " input bands were supplied");
+				}
+				
+				InputBand input;
+				input.sourceType = dtype;
+				input.expression = (int)(expressions.size());
+				for (int band = 0; band < numInputBands; ++band)
+				{
+					if (expression.refersTo(band + 1) && inputs[band].hasNoData)
+					{
+						expression.setBandNoData(band + 1, inputs[band].fillValue);
+						if (input.hasNoData == 0)
+						{
+							input.hasNoData = 1;
+							input.fillValue = std::is_floating_point<PrimitiveTy>::value ? std::numeric_limits<double>::quiet_NaN() : inputs[band].fillValue;
+							input.noDataValue = input.fillValue;
+						}
+					}
+				}
+				
+				if (input.hasNoData) {
+					expression.setOutputNoData(input.fillValue);
+				}
+				
+				expressions.push_back(expression);
+				inputs.push_back(input);
+			}
+			
+			int numBands = (int)(inputs.size());
+			
+			//Cloud Optimized GeoTiffs are first written to an intermediate file with internal overviews, which is then laid out in COG order
+			//(The intermediate file is only read once, so it uses fast lossless compression regardless of the requested profile)
+			bool cloudOptimised = (options.format == OutputFormat::COG);
+			MemoryBudget budget(options.memoryBudget);
+			std::string writeFilename = filename;
+			if (cloudOptimised == true)
+			{
+				//The intermediate file is kept in memory if its uncompressed size (including overviews) fits within the memory budget,
+				//and is otherwise written to GDAL's temporary directory (CPL_TMPDIR) rather than alongside the output
+				uint64_t intermediateBytes = (((uint64_t)(outputGrid.width) * outputGrid.height * numBands * sizeof(PrimitiveTy)) / 3) * 4;
+				bool inMemory = budget.canReserve(intermediateBytes);
+				std::string tempFilename = CPLGenerateTempFilename("mergetiff_cog");
+				writeFilename = (inMemory ? "/vsimem/" + std::string(CPLGetFilename(tempFilename.c_str())) : tempFilename) + ".tif";
+				if (inMemory == true) {
+					budget.reserve(intermediateBytes);
+				}
+				
+				//Never overwrite an existing file
+				VSIStatBufL existingStats;
+				if (VSIStatL(writeFilename.c_str(), &existingStats) == 0) {
+					return ErrorHandling::handleError<GDALDatasetRef>("intermediate file \"" + writeFilename + "\" already exists");
+				}
+				
+				creationOptions = DriverOptions::geoTiffOptions(dtype, CompressionProfile(CompressionCodec::Deflate, 1), options.sparseOutput);
+			}
+			
+			//Identify the bands whose compressed tiles can be copied directly into the output, which must then be tiled and band-interleaved
+			//(All other bands are decoded and re-encoded, and are the only bands written through GDAL. Bands that computed bands refer to must be decoded.)
+			std::map<int, TilePassthrough::SourceTiles> passthrough;
+			bool canInterleaveByBand = (layout.bandInterleaved || options.interleave == Interleave::Auto);
+			if (options.copyCompressedTiles && cloudOptimised == false && layout.tiled && canInterleaveByBand)
+			{
+				for (int index = 0; index < numInputBands; ++index)
+				{
+					bool referenced = false;
+					for (auto& expression : expressions) {
+						referenced = referenced || expression.refersTo(index + 1);
+					}
+					
+					TilePassthrough::SourceTiles tiles;
+					if (referenced == false && inputs[index].sourceType == dtype && inputs[index].transform.isIdentity() && inputs[index].aligned == false && TilePassthrough::inspectBand(rasterBands[index], creationOptions, layout.blockSize, tiles))
+					{
+						inputs[index].passthrough = true;
+						passthrough[index] = tiles;
+					}
+				}
+			}
+			
+			int decodedBands = numBands - (int)(passthrough.size());
+			if (passthrough.empty() == false)
+			{
+				layout.bandInterleaved = true;
+				if (options.sparseOutput == false) {
+					creationOptions.add("SPARSE_OK=TRUE");
+				}
+				
+				//The copied tiles are appended after GDAL has written the file, so ensure that their offsets will be representable
+				uint64_t estimatedBytes = (uint64_t)(decodedBands) * outputGrid.width * outputGrid.height * sizeof(PrimitiveTy);
+				for (auto& band : passthrough) {
+					estimatedBytes += band.second.totalBytes();
+				}
+				if (estimatedBytes > 4000000000ull) {
+					creationOptions.add("BIGTIFF=YES");
+				}
+			}
+			
+			layout.addCreationOptions(creationOptions);
+			
+			//Attempt to create the output dataset
+			Stopwatch phaseTime;
+			GDALDataset* datasetPtr = tiffDriver->Create(writeFilename.c_str(), outputGrid.width, outputGrid.height, numBands, dtype, creationOptions.get());
+			if (datasetPtr == nullptr) {
+				return ErrorHandling::handleError<GDALDatasetRef>("failed to open output dataset \"" + writeFilename + "\"");
+			}
+			
+			//Copy the dataset metadata and the per-band metadata before any pixel data is written
+			GDALDatasetRef dataset(datasetPtr);
+			if (metadataDataset) {
+				DatasetMetadata::copyDatasetMetadata(MERGETIFF_SMART_POINTER_GET(metadataDataset), datasetPtr);
+			}
+			for (int index = 0; index < numBands; ++index)
+			{
+				//Computed bands are described by their expressions
+				const InputBand& input = inputs[index];
+				if (input.expression >= 0)
+				{
+					datasetPtr->GetRasterBand(index+1)->SetDescription(expressions[input.expression].expression().c_str());
+					if (input.hasNoData) {
+						datasetPtr->GetRasterBand(index+1)->SetNoDataValue(input.fillValue);
+					}
+					
+					continue;
+				}
+				
+				DatasetMetadata::copyBandMetadata(rasterBands[index], datasetPtr->GetRasterBand(index+1));
+				
+				//If the band is converted then its "no data" sentinel value must be representable in the output datatype
+				if (input.hasNoData && (input.sourceType != dtype || input.transform.isIdentity() == false)) {
+					datasetPtr->GetRasterBand(index+1)->SetNoDataValue(input.fillValue);
+				}
+			}
+			
+			//When aligning bands, the output uses the computed grid rather than the geotransform of the metadata dataset
+			if (options.alignment != GridAlignment::None) {
+				datasetPtr->SetGeoTransform(outputGrid.geoTransform);
+			}
+			
+			//Create empty overview levels that will be filled from the full-resolution tiles while they are still in memory
+			std::vector<int> overviewFactors = cloudOptimised ? TiledMerge::overviewFactors(outputGrid.width, outputGrid.height, layout.blockSize) : std::vector<int>();
+			if (overviewFactors.empty() == false && datasetPtr->BuildOverviews("NONE", (int)(overviewFactors.size()), overviewFactors.data(), 0, nullptr, nullptr, nullptr) == CE_Failure)
+			{
+				MERGETIFF_SMART_POINTER_RESET(dataset, nullptr);
+				GDALDeleteDataset(tiffDriver, writeFilename.c_str());
+				return ErrorHandling::handleError<GDALDatasetRef>("failed to create overviews for output dataset \"" + writeFilename + "\"");
+			}
+			
+			report.metadataSeconds += phaseTime.restart();
+			
+			//Divide the output into tiles aligned to the output blocks (if every band is copied directly then there are no tiles to decode)
+			int blockWidth = layout.blockWidth(outputGrid.width);
+			int blockHeight = layout.blockHeight();
+			TileGrid grid(outputGrid.width, outputGrid.height, blockWidth, blockHeight);
+			uint64_t numTiles = (decodedBands > 0) ? grid.numTiles() : 0;
+			unsigned int numThreads = ThreadPool::resolveThreadCount(options.numThreads);
+			uint64_t window = (options.tilesInFlight > 0) ? options.tilesInFlight : numThreads * 2;
+			
+			//Each tile in flight has its own band-sequential buffer, which is reused once the tile has been written
+			uint64_t tileElements = (uint64_t)(blockWidth) * blockHeight * numBands;
+			
+			//Bands that are converted by our own kernels are first read into a scratch buffer in their native datatype
+			uint64_t scratchBytes = requiresScratch ? (uint64_t)(blockWidth) * blockHeight * sizeof(double) : 0;
+			
+			//Each tile in flight also has a buffer for its reduced versions at each overview level
+			std::vector<uint64_t> levelOffsets;
+			uint64_t overviewElements = 0;
+			for (auto factor : overviewFactors)
+			{
+				uint64_t reducedWidth = PyramidReduction::reducedSize(blockWidth, factor);
+				uint64_t reducedHeight = PyramidReduction::reducedSize(blockHeight, factor);
+				levelOffsets.push_back(overviewElements);
+				overviewElements += reducedWidth * reducedHeight * numBands;
+			}
+			
+			//If band statistics were requested, each worker thread accumulates the statistics of the tiles that it has read
+			//(Accumulators for 16-bit datatypes hold one bin per value, so they are held per thread rather than per tile in flight)
+			uint64_t statisticsBytes = options.computeStatistics ? numBands * BandStatisticsAccumulator<PrimitiveTy>::bytes() : 0;
+			budget.reserve(statisticsBytes * numThreads);
+			
+			//If a memory budget was specified, size the GDAL block cache and the number of tiles in flight to fit within it
+			uint64_t tileBytes = ((tileElements + overviewElements) * sizeof(PrimitiveTy)) + scratchBytes;
+			uint64_t cacheBytes = budget.cacheBytes(tileElements * sizeof(PrimitiveTy));
+			std::unique_ptr<ScopedCacheLimit> cacheLimit(budget.limited() ? new ScopedCacheLimit(cacheBytes) : nullptr);
+			window = budget.tilesInFlight(std::max<uint64_t>(1, window), tileBytes, cacheBytes);
+			if (window == 0 && numTiles > 0)
+			{
+				MERGETIFF_SMART_POINTER_RESET(dataset, nullptr);
+				GDALDeleteDataset(tiffDriver, writeFilename.c_str());
+				return ErrorHandling::handleError<GDALDatasetRef>("the memory budget of " + std::to_string(budget.bytes() / (1024 * 1024)) + "MB is too small to merge a single tile");
+			}
+			
+			//There is no benefit in having more worker threads than tiles in flight
+			window = std::min<uint64_t>(window, numTiles);
+			numThreads = (unsigned int)(std::max<uint64_t>(1, std::min<uint64_t>(numThreads, window)));
+			std::vector< std::vector<PrimitiveTy> > slots(window, std::vector<PrimitiveTy>(tileElements));
+			std::vector< std::vector<uint8_t> > scratch(window, std::vector<uint8_t>(scratchBytes));
+			std::vector< std::vector<PrimitiveTy> > overviewSlots(window, std::vector<PrimitiveTy>(overviewElements));
+			
+			//The statistics of the decoded bands are accumulated from the tiles while they are in memory, excluding each band's "no data" value
+			//(The accumulators of every worker thread are merged once all of the tiles have been written, so the tiles are only ever read once)
+			std::vector< BandStatisticsAccumulator<PrimitiveTy> > bandAccumulators;
+			for (int index = 0; index < numBands && options.computeStatistics; ++index) {
+				bandAccumulators.push_back(BandStatisticsAccumulator<PrimitiveTy>(inputs[index].hasNoData, inputs[index].fillValue));
+			}
+			std::vector< std::vector< BandStatisticsAccumulator<PrimitiveTy> > > threadStatistics(options.computeStatistics ? numThreads : 0, bandAccumulators);
+			
+			//Each tile in flight also records the time its read took, the number of bytes it read from each band, and which of its bands are empty
+			std::vector<double> slotSeconds(window, 0.0);
+			std::vector< std::vector<uint64_t> > slotBytes(window, std::vector<uint64_t>(numBands, 0));
+			std::vector< std::vector<uint8_t> > slotEmpty(window, std::vector<uint8_t>(numBands, 0));
+			std::vector<uint64_t> bandBytes(numBands, 0);
+			BandReaderPool readers(rasterBands, numThreads);
+			std::deque< std::future<bool> > pending;
+			ThreadPool pool(numThreads);
+			
+			//Queues the read for a tile on the worker threads
+			auto submitTile = [&](uint64_t tileIndex)
+			{
+				return pool.submit([&grid, &slots, &scratch, &overviewSlots, &slotSeconds, &slotBytes, &slotEmpty, &threadStatistics, &readers, &inputs, &expressions, &outputGrid, &options, &overviewFactors, &levelOffsets, window, tileIndex]() -> bool
+				{
+					Stopwatch readTime;
+					RasterWindow tile = grid.window(tileIndex);
+					PrimitiveTy* buffer = slots[tileIndex % window].data();
+					uint8_t* scratchBuffer = scratch[tileIndex % window].data();
+					BandReaderPool::Context* context = readers.acquire();
+					
+					bool success = true;
+					for (size_t band = 0; band < readers.numBands() && success; ++band)
+					{
+						if (inputs[band].passthrough == false) {
+							success = TiledMerge::readBandTile<PrimitiveTy>(readers, context, band, inputs[band], outputGrid, tile, buffer + (band * tile.pixels()), scratchBuffer, options, slotBytes[tileIndex % window][band]);
+						}
+					}
+					
+					readers.release(context);
+					
+					//Evaluate the computed bands, which follow the input bands in the tile's buffer
+					for (size_t band = readers.numBands(); band < inputs.size() && success; ++band) {
+						expressions[inputs[band].expression].evaluate<PrimitiveTy>(buffer, tile.pixels(), tile.pixels(), buffer + (band * tile.pixels()));
+					}
+					
+					//Identify the decoded bands that contain nothing but their fill value, which is what GDAL reads from an unwritten block of the output
+					for (size_t band = 0; band < inputs.size() && success; ++band)
+					{
+						const InputBand& input = inputs[band];
+						bool empty = (input.passthrough == false && (input.hasNoData || input.fillValue == 0.0));
+						slotEmpty[tileIndex % window][band] = (empty && TiledMerge::isFilled<PrimitiveTy>(buffer + (band * tile.pixels()), tile.pixels(), (PrimitiveTy)(input.fillValue))) ? 1 : 0;
+					}
+					
+					//Accumulate the statistics of each decoded band (the tiles of copied bands are never decoded)
+					for (size_t band = 0; band < inputs.size() && success && threadStatistics.empty() == false; ++band)
+					{
+						if (inputs[band].passthrough == false) {
+							threadStatistics[ThreadPool::workerIndex()][band].add(buffer + (band * tile.pixels()), tile.pixels());
+						}
+					}
+					
+					//Reduce each band to each of the overview levels, using the previous level as the input for the next
+					PrimitiveTy* overviewBuffer = overviewSlots[tileIndex % window].data();
+					for (size_t band = 0; band < inputs.size() && success; ++band)
+					{
+						const PrimitiveTy* source = buffer + (band * tile.pixels());
+						int width = tile.width;
+						int height = tile.height;
+						for (size_t level = 0; level < overviewFactors.size(); ++level)
+						{
+							int reducedWidth = PyramidReduction::reducedSize(width, 2);
+							int reducedHeight = PyramidReduction::reducedSize(height, 2);
+							PrimitiveTy* dest = overviewBuffer + levelOffsets[level] + (band * (uint64_t)(reducedWidth) * reducedHeight);
+							PyramidReduction::reduceBand<PrimitiveTy>(source, width, height, dest, options.overviewResampling, inputs[band].hasNoData != 0, (PrimitiveTy)(inputs[band].fillValue));
+							source = dest;
+							width = reducedWidth;
+							height = reducedHeight;
+						}
+					}
+					
+					slotSeconds[tileIndex % window] = readTime.elapsed();
+					return success;
+				});
+			};
+			
+			//Fill the read-ahead window
+			Stopwatch loopTime;
+			uint64_t nextTile = 0;
+			for (; nextTile < window; ++nextTile) {
+				pending.push_back(submitTile(nextTile));
+			}
+			
+			//Write each tile in order as soon as it has been read (when copying tiles directly, the copy accounts for the copied bands' share of the progress)
+			std::string error;
+			double decodeProgressScale = (double)(decodedBands) / (double)(numBands);
+			if (progressCallback != nullptr) {
+				progressCallback(0.0, "", nullptr);
+			}
+			for (uint64_t tileIndex = 0; tileIndex < numTiles; ++tileIndex)
+			{
+				bool readSucceeded = pending.front().get();
+				pending.pop_front();
+				if (readSucceeded == false)
+				{
+					error = "failed to read data from GDAL raster band";
+					break;
+				}
+				
+				//Accumulate the statistics for the tile's read
+				report.readSeconds += slotSeconds[tileIndex % window];
+				for (int band = 0; band < numBands; ++band) {
+					bandBytes[band] += slotBytes[tileIndex % window][band];
+				}
+				
+				//Empty bands are not written, and neither are tiles whose decoded bands are all empty (empty bands of pixel-interleaved tiles must still be written)
+				const std::vector<uint8_t>& emptyBands = slotEmpty[tileIndex % window];
+				int numEmpty = (int)(std::count(emptyBands.begin(), emptyBands.end(), 1));
+				
+				//When tiles are being copied directly, only the decoded bands are written (the other bands' tiles must remain empty)
+				Stopwatch encodeTime;
+				RasterWindow tile = grid.window(tileIndex);
+				CPLErr result = CE_None;
+				if (numEmpty == decodedBands) {
+					report.tilesSkipped += 1;
+				}
+				else if (passthrough.empty() && (numEmpty == 0 || layout.bandInterleaved == false))
+				{
+					result = datasetPtr->RasterIO(
+						GF_Write,
+						tile.x,
+						tile.y,
+						tile.width,
+						tile.height,
+						slots[tileIndex % window].data(),
+						tile.width,
+						tile.height,
+						dtype,
+						numBands,
+						nullptr,
+						sizeof(PrimitiveTy),
+						sizeof(PrimitiveTy) * tile.width,
+						sizeof(PrimitiveTy) * tile.pixels(),
+						nullptr
+					);
+				}
+				else
+				{
+					for (int band = 0; band < numBands && result != CE_Failure; ++band)
+					{
+						if (inputs[band].passthrough == false && emptyBands[band] == 0)
+						{
+							result = datasetPtr->GetRasterBand(band + 1)->RasterIO(
+								GF_Write,
+								tile.x,
+								tile.y,
+								tile.width,
+								tile.height,
+								slots[tileIndex % window].data() + (band * tile.pixels()),
+								tile.width,
+								tile.height,
+								dtype,
+								sizeof(PrimitiveTy),
+								sizeof(PrimitiveTy) * tile.width,
+								nullptr
+							);
+						}
+					}
+				}
+				
+				//Write the reduced versions of the tile to each of the overview levels (the reduced versions of empty bands are also empty)
+				for (size_t level = 0; level < overviewFactors.size() && result != CE_Failure; ++level)
+				{
+					int factor = overviewFactors[level];
+					int reducedWidth = PyramidReduction::reducedSize(tile.width, factor);
+					int reducedHeight = PyramidReduction::reducedSize(tile.height, factor);
+					for (int band = 0; band < numBands && result != CE_Failure; ++band)
+					{
+						if (emptyBands[band] == 1) {
+							continue;
+						}
+						
+						GDALRasterBand* overview = datasetPtr->GetRasterBand(band + 1)->GetOverview((int)(level));
+						int x = tile.x / factor;
+						int y = tile.y / factor;
+						result = (overview == nullptr) ? CE_Failure : overview->RasterIO(
+							GF_Write,
+							x,
+							y,
+							std::min(reducedWidth, overview->GetXSize() - x),
+							std::min(reducedHeight, overview->GetYSize() - y),
+							overviewSlots[tileIndex % window].data() + levelOffsets[level] + (band * (uint64_t)(reducedWidth) * reducedHeight),
+							std::min(reducedWidth, overview->GetXSize() - x),
+							std::min(reducedHeight, overview->GetYSize() - y),
+							dtype,
+							sizeof(PrimitiveTy),
+							sizeof(PrimitiveTy) * reducedWidth,
+							nullptr
+						);
+					}
+				}
+				
+				report.encodeSeconds += encodeTime.elapsed();
+				report.tilesProcessed += 1;
+				if (result == CE_Failure)
+				{
+					error = "failed to write data to output dataset \"" + writeFilename + "\"";
+					break;
+				}
+				
+				//The slot for this tile is now free, so queue the next read (while the process exceeds the memory budget, reads are deferred until the queue drains)
+				while (nextTile < numTiles && nextTile - (tileIndex + 1) < window && (pending.empty() || budget.withinBudget())) {
+					pending.push_back(submitTile(nextTile++));
+				}
+				
+				//Report progress, allowing the callback to cancel the merge (for COG output, the final copy accounts for the second half)
+				double progressScale = cloudOptimised ? 0.5 : decodeProgressScale;
+				if (progressCallback != nullptr && progressCallback(progressScale * (double)(tileIndex + 1) / (double)(numTiles), "", nullptr) == 0)
+				{
+					error = "merge operation was cancelled";
+					break;
+				}
+			}
+			
+			//Wait for any outstanding reads to complete before their buffers are released
+			for (auto& read : pending) {
+				read.wait();
+			}
+			
+			report.threads = numThreads;
+			report.workerWallSeconds += loopTime.elapsed();
+			
+			//If the merge failed then remove the partially-written output file
+			if (error.empty() == false)
+			{
+				MERGETIFF_SMART_POINTER_RESET(dataset, nullptr);
+				GDALDeleteDataset(tiffDriver, writeFilename.c_str());
+				return ErrorHandling::handleError<GDALDatasetRef>(error);
+			}
+			
+			phaseTime.restart();
+			dataset->FlushCache();
+			report.flushSeconds += phaseTime.restart();
+			if (cloudOptimised)
+			{
+				dataset = TiledMerge::writeCloudOptimised(filename, dataset, dtype, layout, compression, options.sparseOutput, progressCallback);
+				report.writeSeconds += phaseTime.restart();
+				if (!dataset) {
+					return dataset;
+				}
+			}
+			
+			//Copy the compressed tiles once GDAL has finished writing the file, then reopen it
+			if (passthrough.empty() == false)
+			{
+				MERGETIFF_SMART_POINTER_RESET(dataset, nullptr);
+				report.flushSeconds += phaseTime.restart();
+				if (TilePassthrough::copyTiles(filename, outputGrid.width, outputGrid.height, layout.blockSize, passthrough, progressCallback, decodeProgressScale, error) == false)
+				{
+					GDALDeleteDataset(tiffDriver, filename.c_str());
+					return ErrorHandling::handleError<GDALDatasetRef>(error);
+				}
+				
+				report.writeSeconds += phaseTime.restart();
+				MERGETIFF_SMART_POINTER_RESET(dataset, (GDALDataset*)(GDALOpen(filename.c_str(), GA_Update)));
+				if (!dataset) {
+					return ErrorHandling::handleError<GDALDatasetRef>("failed to reopen output dataset \"" + filename + "\"");
+				}
+			}
+			
+			//Merge the statistics accumulated by each worker thread and store them in the metadata of the output bands (GDAL writes them when the dataset is closed)
+			if (options.computeStatistics == true)
+			{
+				report.bandStatistics.clear();
+				for (int index = 0; index < numBands; ++index)
+				{
+					for (auto& thread : threadStatistics) {
+						bandAccumulators[index].merge(thread[index]);
+					}
+					
+					BandStatistics bandStatistics = inputs[index].passthrough ? BandStatistics() : bandAccumulators[index].finish();
+					if (bandStatistics.valid() == true) {
+						bandStatistics.writeToBand(dataset->GetRasterBand(index + 1));
+					}
+					
+					report.bandStatistics.push_back(bandStatistics);
+				}
+			}
+			
+			//Attribute the data read from each band to its input file
+			for (int index = 0; index < numInputBands; ++index)
+			{
+				GDALDataset* source = rasterBands[index]->GetDataset();
+				MergeStats::InputStats& input = report.input((source != nullptr) ? source->GetDescription() : "");
+				input.bytesRead += bandBytes[index];
+			}
+			for (auto& band : passthrough)
+			{
+				report.input(band.second.filename).bytesRead += band.second.totalBytes();
+				report.tilesCopied += band.second.offsets.size();
+			}
+			
+			VSIStatBufL outputStats;
+			if (VSIStatL(filename.c_str(), &outputStats) == 0) {
+				report.bytesWritten = outputStats.st_size;
+			}
+			
+			report.peakMemoryBytes = MemoryUsage::peakResidentBytes();
+			report.totalSeconds = report.openSeconds + totalTime.elapsed();
+			return dataset;
+		}
+		
+	private:
+		
+		//Describes how an input band is converted and aligned to the output
+		class InputBand
+		{
+			public:
+				
+				InputBand() : sourceType(GDT_Unknown), hasNoData(0), noDataValue(0.0), fillValue(0.0), aligned(false), passthrough(false), expression(-1) {}
+				
+				GDALDataType sourceType;
+				DatatypeConversion::ValueTransform transform;
+				int hasNoData;
+				double noDataValue;
+				
+				//The value (in the output datatype) used for pixels of the output grid that the band does not cover
+				double fillValue;
+				
+				//The band's own grid, and whether it needs to be offset or resampled to match the output grid
+				RasterGrid grid;
+				bool aligned;
+				
+				//Whether the band's compressed tiles are copied directly into the output rather than being decoded
+				bool passthrough;
+				
+				//For computed bands, the index of the expression that computes the band (-1 for input bands)
+				int expression;
+		};
+		
+		//Determines the overview factors for a Cloud Optimized GeoTiff, stopping once an overview fits within a single block
+		//(Each overview is generated from individual full-resolution tiles, so the factor cannot exceed the block size)
+		static inline std::vector<int> overviewFactors(int width, int height, unsigned int blockSize)
+		{
+			std::vector<int> factors;
+			for (int factor = 2; factor <= (int)(blockSize); factor *= 2)
+			{
+				if (PyramidReduction::reducedSize(width, factor / 2) <= (int)(blockSize) && PyramidReduction::reducedSize(height, factor / 2) <= (int)(blockSize)) {
+					break;
+				}
+				
+				factors.push_back(factor);
+			}
+			
+			return factors;
+		}
+		
+		//Copies an intermediate dataset with internal overviews to a Cloud Optimized GeoTiff, then removes the intermediate file
+		//(If sparse output is requested then empty blocks are omitted from the copy where the driver supports it)
+		static inline GDALDatasetRef writeCloudOptimised(const std::string& filename, GDALDatasetRef& intermediate, GDALDataType dtype, const OutputLayout& layout, const CompressionProfile& compression, bool sparse, GDALProgressFunc progressCallback)
+		{
+			//Use the COG driver if it is available (GDAL 3.1 or newer), otherwise copy the overviews with the GeoTiff driver
+			GDALDriver* cogDriver = ((GDALDriver*)GDALGetDriverByName("COG"));
+			GDALDriver* tiffDriver = ((GDALDriver*)GDALGetDriverByName("GTiff"));
+			//(The COG driver only supports band interleaving in GDAL 3.11 or newer, so it is only requested when required)
+			ArgsArray copyOptions = DriverOptions::cloudOptimisedOptions(dtype, layout.blockSize, compression, sparse);
+			if (layout.bandInterleaved == true) {
+				copyOptions.add("INTERLEAVE=BAND");
+			}
+			if (cogDriver == nullptr)
+			{
+				copyOptions = DriverOptions::geoTiffOptions(dtype, compression, sparse);
+				layout.addCreationOptions(copyOptions);
+				copyOptions.add("COPY_SRC_OVERVIEWS=YES");
+			}
+			
+			//Report the progress of the copy as the second half of the merge
+			void* scaledProgress = (progressCallback != nullptr) ? GDALCreateScaledProgress(0.5, 1.0, progressCallback, nullptr) : nullptr;
+			GDALDriver* driver = (cogDriver != nullptr) ? cogDriver : tiffDriver;
+			GDALDataset* dataset = driver->CreateCopy(
+				filename.c_str(),
+				MERGETIFF_SMART_POINTER_GET(intermediate),
+				false,
+				copyOptions.get(),
+				(scaledProgress != nullptr) ? GDALScaledProgress : nullptr,
+				scaledProgress
+			);
+			
+			if (scaledProgress != nullptr) {
+				GDALDestroyScaledProgress(scaledProgress);
+			}
+			
+			//Remove the intermediate file
+			std::string intermediateFilename = intermediate->GetDescription();
+			MERGETIFF_SMART_POINTER_RESET(intermediate, nullptr);
+			GDALDeleteDataset(tiffDriver, intermediateFilename.c_str());
+			
+			//Verify that we were able to create the dataset
+			if (dataset == nullptr) {
+				return ErrorHandling::handleError<GDALDatasetRef>("failed to create Cloud Optimized GeoTiff \"" + filename + "\"");
+			}
+			
+			return GDALDatasetRef(dataset);
+		}
+		
+		//Reads the region of an input band corresponding to an output tile, converting and aligning it as required
+		//(The number of bytes read from the band, in its native datatype, is stored in bytesRead)
+		template <typename PrimitiveTy>
+		static inline bool readBandTile(BandReaderPool& readers, BandReaderPool::Context* context, size_t band, const InputBand& input, const RasterGrid& outputGrid, const RasterWindow& tile, PrimitiveTy* output, uint8_t* scratch, const MergeOptions& options, uint64_t& bytesRead)
+		{
+			bytesRead = 0;
+			
+			//By default, the tile maps directly onto the same window of the input band
+			RasterWindow source = tile;
+			RasterWindow destination(0, 0, tile.width, tile.height);
+			GDALRasterIOExtraArg extraArg;
+			INIT_RASTERIO_EXTRA_ARG(extraArg);
+			
+			//For aligned bands, determine the region of the tile that the band covers and the corresponding source window
+			if (input.aligned)
+			{
+				GridMapping mapping = GridMapping::map(outputGrid, tile, input.grid);
+				
+				//Pixels that the band does not cover are filled with its "no data" value
+				if (mapping.empty || mapping.destination.pixels() != tile.pixels()) {
+					std::fill(output, output + tile.pixels(), (PrimitiveTy)(input.fillValue));
+				}
+				
+				if (mapping.empty) {
+					return true;
+				}
+				
+				source = mapping.sourceWindow();
+				destination = mapping.destination;
+				extraArg.eResampleAlg = options.resampling;
+				extraArg.bFloatingPointWindowValidity = TRUE;
+				extraArg.dfXOff = mapping.sourceX;
+				extraArg.dfYOff = mapping.sourceY;
+				extraArg.dfXSize = mapping.sourceWidth;
+				extraArg.dfYSize = mapping.sourceHeight;
+			}
+			
+			//Windows that GDAL reports as empty are filled without being read, since GDAL would read them as the band's "no data" value (which maps to
+			//the fill value) or as zero (which only maps to the fill value if the band has no transformation)
+			PrimitiveTy* destBuffer = output + ((uint64_t)(destination.y) * tile.width) + destination.x;
+			if ((input.hasNoData || input.transform.isIdentity()) && readers.isEmpty(context, band, source.x, source.y, source.width, source.height))
+			{
+				for (int row = 0; row < destination.height; ++row)
+				{
+					PrimitiveTy* rowStart = destBuffer + ((uint64_t)(row) * tile.width);
+					std::fill(rowStart, rowStart + destination.width, (PrimitiveTy)(input.fillValue));
+				}
+				
+				return true;
+			}
+			
+			//Bands without a value transformation are converted to the output datatype by GDAL as they are read
+			GDALDataType dtype = DatatypeConversion::primitiveToGdal<PrimitiveTy>();
+			bytesRead = (uint64_t)(source.pixels()) * GDALGetDataTypeSizeBytes(input.sourceType);
+			if (input.transform.isIdentity())
+			{
+				return readers.read(
+					context,
+					band,
+					source.x,
+					source.y,
+					source.width,
+					source.height,
+					destBuffer,
+					destination.width,
+					destination.height,
+					dtype,
+					sizeof(PrimitiveTy),
+					sizeof(PrimitiveTy) * tile.width,
+					&extraArg
+				);
+			}
+			
+			//Read the band in its native datatype and then apply the transformation one row at a time
+			if (readers.read(context, band, source.x, source.y, source.width, source.height, scratch, destination.width, destination.height, input.sourceType, 0, 0, &extraArg) == false) {
+				return false;
+			}
+			
+			uint64_t sourceRowBytes = (uint64_t)(destination.width) * GDALGetDataTypeSizeBytes(input.sourceType);
+			for (int row = 0; row < destination.height; ++row)
+			{
+				bool converted = DatatypeConversion::transformValues<PrimitiveTy>(
+					input.sourceType,
+					scratch + (row * sourceRowBytes),
+					destBuffer + ((uint64_t)(row) * tile.width),
+					destination.width,
+					input.transform,
+					input.hasNoData != 0,
+					input.noDataValue
+				);
+				
+				if (converted == false) {
+					return false;
+				}
+			}
+			
+			return true;
+		}
+		
+		//Determines if every value in a buffer is equal to the fill value (a NaN fill value matches NaN values)
+		//(The values are compared in fixed-size runs without branching so that the compiler can vectorise the comparisons, stopping at the first run that differs)
+		template <typename PrimitiveTy>
+		static inline bool isFilled(const PrimitiveTy* values, uint64_t count, PrimitiveTy fillValue)
+		{
+			const uint64_t runLength = 256;
+			bool matchNaN = (fillValue != fillValue);
+			for (uint64_t start = 0; start < count; start += runLength)
+			{
+				uint64_t end = std::min(start + runLength, count);
+				bool differs = false;
+				for (uint64_t index = start; index < end; ++index) {
+					differs |= matchNaN ? (values[index] == values[index]) : (values[index] != fillValue);
+				}
+				
+				if (differs == true) {
+					return false;
+				}
+			}
+			
+			return true;
+		}
+};
+
+} //End namespace mergetiff
+
+#endif
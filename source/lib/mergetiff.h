@@ -1,12 +1,33 @@
 #include "LibrarySettings.h"
 
 #include "ArgsArray.h"
+#include "BandExpression.h"
+#include "BandReaderPool.h"
+#include "BandStatistics.h"
+#include "ChannelInterleaving.h"
+#include "CompressionTuning.h"
 #include "DatasetManagement.h"
+#include "DatasetMetadata.h"
 #include "DatatypeConversion.h"
 #include "DriverOptions.h"
 #include "ErrorHandling.h"
+#include "MappedRaster.h"
+#include "MemoryBudget.h"
+#include "MergeOptions.h"
+#include "MergeStats.h"
 #include "OptionsParsing.h"
+#include "OutputLayout.h"
+#include "PyramidReduction.h"
+#include "RasterAllocator.h"
+#include "RasterBlockStream.h"
 #include "RasterData.h"
+#include "RasterGrid.h"
 #include "RasterIO.h"
+#include "RasterView.h"
+#include "RasterWindow.h"
 #include "SmartPointers.h"
+#include "ThreadPool.h"
+#include "TiffDirectory.h"
+#include "TiledMerge.h"
+#include "TilePassthrough.h"
 #include "Utility.h"